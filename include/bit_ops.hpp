@@ -0,0 +1,86 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <limits>
+#include <type_traits>
+
+#if defined( _MSC_VER ) && !defined( __clang__ )
+#    include <intrin.h>
+#endif
+
+#include <hedley.hpp>
+
+// The bit operations of <bit> (C++20) that the containers and kernels use, for C++17: popcount and
+// countr_zero map to the compiler builtins (POPCNT and TZCNT/BSF), has_single_bit and bit_ceil are constexpr.
+
+namespace sax {
+
+template<typename T>
+[[nodiscard]] HEDLEY_ALWAYS_INLINE int popcount ( T const x_ ) noexcept {
+    static_assert ( std::is_unsigned<T>::value and sizeof ( T ) <= 8u, "popcount requires an unsigned integer of at most 64 bits" );
+#if defined( _MSC_VER ) && !defined( __clang__ )
+    return static_cast<int> ( __popcnt64 ( static_cast<std::uint64_t> ( x_ ) ) );
+#else
+    return __builtin_popcountll ( static_cast<unsigned long long> ( x_ ) );
+#endif
+}
+
+// The number of trailing zero bits, the width of T if x_ is 0.
+template<typename T>
+[[nodiscard]] HEDLEY_ALWAYS_INLINE int countr_zero ( T const x_ ) noexcept {
+    static_assert ( std::is_unsigned<T>::value and sizeof ( T ) <= 8u,
+                    "countr_zero requires an unsigned integer of at most 64 bits" );
+    if ( HEDLEY_UNLIKELY ( not x_ ) )
+        return std::numeric_limits<T>::digits;
+#if defined( _MSC_VER ) && !defined( __clang__ )
+    unsigned long i;
+    _BitScanForward64 ( &i, static_cast<std::uint64_t> ( x_ ) );
+    return static_cast<int> ( i );
+#else
+    return __builtin_ctzll ( static_cast<unsigned long long> ( x_ ) );
+#endif
+}
+
+template<typename T>
+[[nodiscard]] constexpr bool has_single_bit ( T const x_ ) noexcept {
+    static_assert ( std::is_unsigned<T>::value, "has_single_bit requires an unsigned integer" );
+    return x_ and not( x_ & ( x_ - 1u ) );
+}
+
+// The smallest power of 2 not less than x_, 1 if x_ is 0.
+template<typename T>
+[[nodiscard]] constexpr T bit_ceil ( T const x_ ) noexcept {
+    static_assert ( std::is_unsigned<T>::value, "bit_ceil requires an unsigned integer" );
+    T r = 1u;
+    while ( r < x_ )
+        r <<= 1;
+    return r;
+}
+
+} // namespace sax
@@ -0,0 +1,119 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef NOMINMAX
+#    define NOMINMAX
+#endif
+
+#include <sysinfoapi.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <type_traits>
+
+#include <hedley.hpp>
+
+#include "winsys.hpp"
+
+namespace sax {
+
+template<typename SizeType, typename = std::enable_if_t<std::is_unsigned<SizeType>::value>>
+struct growth_policy {
+    [[nodiscard]] static SizeType grow ( SizeType const & cap_b_ ) noexcept { return cap_b_ << 1; }
+    [[nodiscard]] static SizeType shrink ( SizeType const & cap_b_ ) noexcept { return cap_b_ >> 1; }
+};
+
+template<typename SizeType, SizeType Increment, typename = std::enable_if_t<std::is_unsigned<SizeType>::value>>
+struct linear_growth_policy {
+    [[nodiscard]] static SizeType grow ( SizeType const & cap_b_ ) noexcept { return cap_b_ + Increment; }
+    [[nodiscard]] static SizeType shrink ( SizeType const & cap_b_ ) noexcept {
+        return cap_b_ > Increment ? cap_b_ - Increment : 0u;
+    }
+};
+
+// Thrown (before committing) when a growth step would leave less than the low-water mark of headroom.
+struct memory_pressure_error : std::runtime_error {
+    memory_pressure_error ( std::size_t const requested_b_, std::size_t const headroom_b_ ) :
+        std::runtime_error{ "memory pressure: growth step exceeds the available headroom" }, requested_b{ requested_b_ },
+        headroom_b{ headroom_b_ } {}
+
+    std::size_t requested_b, headroom_b;
+};
+
+// The smaller of available physical memory and the job object headroom, re-queried at most every refresh_ms.
+struct memory_headroom {
+
+    static constexpr std::uint64_t refresh_ms = 100u;
+
+    [[nodiscard]] static std::size_t get ( ) noexcept {
+        if ( HEDLEY_UNLIKELY ( GetTickCount64 ( ) - s_stamp_ms.load ( std::memory_order_relaxed ) >= refresh_ms ) )
+            return refresh ( );
+        return s_headroom_b.load ( std::memory_order_relaxed );
+    }
+
+    [[maybe_unused]] static std::size_t refresh ( ) noexcept {
+        std::size_t const h = std::min ( sax::win::available_physical_memory ( ), sax::win::job_memory_headroom ( ) );
+        s_headroom_b.store ( h, std::memory_order_relaxed );
+        s_stamp_ms.store ( GetTickCount64 ( ), std::memory_order_relaxed );
+        return h;
+    }
+
+    private:
+    static inline std::atomic<std::size_t> s_headroom_b{ 0u };
+    static inline std::atomic<std::uint64_t> s_stamp_ms{ 0u };
+};
+
+// Takes the step of BasePolicy while it is small compared to the headroom, and at most 1 / HeadroomDivisor of
+// the headroom otherwise, so the growth factor drops as memory runs out. Throws memory_pressure_error when even
+// a 64KB step would eat into the last LowWaterB bytes.
+template<typename SizeType, typename BasePolicy = growth_policy<SizeType>, std::size_t HeadroomDivisor = 4u,
+         std::size_t LowWaterB = 268'435'456u> // 256MB
+struct adaptive_growth_policy {
+
+    [[nodiscard]] static SizeType grow ( SizeType const & cap_b_ ) {
+        SizeType const want = BasePolicy::grow ( cap_b_ );
+        if ( HEDLEY_UNLIKELY ( want <= cap_b_ ) )
+            return want;
+        std::size_t step     = static_cast<std::size_t> ( want - cap_b_ );
+        std::size_t headroom = memory_headroom::get ( );
+        if ( HEDLEY_UNLIKELY ( step > headroom / HeadroomDivisor ) ) {
+            headroom = memory_headroom::refresh ( ); // Don't act on a stale value.
+            step     = std::min ( step, std::max ( ( headroom / HeadroomDivisor ) & ~( page_size_b - 1u ), page_size_b ) );
+        }
+        if ( HEDLEY_UNLIKELY ( headroom < LowWaterB or step > headroom - LowWaterB ) )
+            throw memory_pressure_error{ step, headroom };
+        return static_cast<SizeType> ( cap_b_ + step );
+    }
+    [[nodiscard]] static SizeType shrink ( SizeType const & cap_b_ ) noexcept { return BasePolicy::shrink ( cap_b_ ); }
+
+    private:
+    static constexpr std::size_t page_size_b = 65'536u; // 64KB
+};
+
+} // namespace sax
@@ -0,0 +1,153 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <hedley.hpp>
+
+// A fast LZ77 block codec in the manner of LZ4: one pass with a hash table of the last position of each 4 byte
+// sequence, no entropy coding. A block is a series of sequences, a token (literal length, match length, 4
+// bits each, extended by bytes of 255), the literals and the 16 bit offset of the match. The last sequence has
+// literals only.
+
+namespace sax::lz {
+
+// The worst case size of the compressed form of n_ bytes.
+[[nodiscard]] constexpr std::size_t bound ( std::size_t const n_ ) noexcept { return n_ + n_ / 255u + 16u; }
+
+namespace detail {
+
+inline constexpr std::size_t min_match = 4u, max_offset = 65'535u;
+inline constexpr int hash_bits = 12;
+
+[[nodiscard]] inline std::uint32_t read32 ( unsigned char const * const p_ ) noexcept {
+    std::uint32_t v;
+    std::memcpy ( &v, p_, 4u );
+    return v;
+}
+
+[[nodiscard]] inline std::uint32_t hash ( std::uint32_t const v_ ) noexcept {
+    return ( v_ * 2'654'435'761u ) >> ( 32 - hash_bits );
+}
+
+[[nodiscard]] inline unsigned char * put_length ( unsigned char * o_, std::size_t n_ ) noexcept {
+    for ( ; n_ >= 255u; n_ -= 255u )
+        *o_++ = 255u;
+    *o_++ = static_cast<unsigned char> ( n_ );
+    return o_;
+}
+
+[[nodiscard]] inline unsigned char * put_literals ( unsigned char * o_, unsigned char const * const l_, std::size_t const n_,
+                                                    unsigned char const match_nibble_ ) noexcept {
+    *o_++ = static_cast<unsigned char> ( ( n_ < 15u ? n_ : 15u ) << 4 | match_nibble_ );
+    if ( n_ >= 15u )
+        o_ = put_length ( o_, n_ - 15u );
+    std::memcpy ( o_, l_, n_ );
+    return o_ + n_;
+}
+
+} // namespace detail
+
+// Compresses [ src_, src_ + n_ ) to dst_, which must hold bound ( n_ ) bytes, returns the compressed size.
+[[nodiscard]] inline std::size_t compress ( void const * const src_, std::size_t const n_, void * const dst_ ) noexcept {
+    using namespace detail;
+    unsigned char const * const in = static_cast<unsigned char const *> ( src_ );
+    unsigned char * out            = static_cast<unsigned char *> ( dst_ );
+    std::uint32_t table[ std::size_t{ 1 } << hash_bits ]{ }; // Position + 1, 0 is empty.
+    std::size_t anchor = 0u, i = 0u;
+    while ( i + min_match <= n_ ) {
+        std::uint32_t const v  = read32 ( in + i );
+        std::uint32_t & slot   = table[ hash ( v ) ];
+        std::size_t const cand = slot;
+        slot                   = static_cast<std::uint32_t> ( i + 1u );
+        if ( cand and i - ( cand - 1u ) <= max_offset and read32 ( in + cand - 1u ) == v ) {
+            std::size_t const m = cand - 1u;
+            std::size_t len     = min_match;
+            while ( i + len < n_ and in[ m + len ] == in[ i + len ] )
+                ++len;
+            std::size_t const ml = len - min_match, off = i - m;
+            out    = put_literals ( out, in + anchor, i - anchor, static_cast<unsigned char> ( ml < 15u ? ml : 15u ) );
+            *out++ = static_cast<unsigned char> ( off );
+            *out++ = static_cast<unsigned char> ( off >> 8 );
+            if ( ml >= 15u )
+                out = put_length ( out, ml - 15u );
+            i = anchor = i + len;
+        }
+        else {
+            ++i;
+        }
+    }
+    out = put_literals ( out, in + anchor, n_ - anchor, 0u );
+    return static_cast<std::size_t> ( out - static_cast<unsigned char *> ( dst_ ) );
+}
+
+// Decompresses the size_ bytes at src_ to dst_, which holds capacity_ bytes, returns the decompressed size, or
+// 0 if the block is corrupt.
+[[nodiscard]] inline std::size_t decompress ( void const * const src_, std::size_t const size_, void * const dst_,
+                                              std::size_t const capacity_ ) noexcept {
+    using namespace detail;
+    unsigned char const * in        = static_cast<unsigned char const *> ( src_ );
+    unsigned char const * const end = in + size_;
+    unsigned char * const out       = static_cast<unsigned char *> ( dst_ );
+    std::size_t o                   = 0u;
+    auto const get_length           = [ & ] ( std::size_t n_ ) noexcept {
+        if ( n_ == 15u ) {
+            unsigned char b;
+            do {
+                if ( HEDLEY_UNLIKELY ( in == end ) )
+                    return ~std::size_t{ 0 };
+                n_ += b = *in++;
+            } while ( b == 255u );
+        }
+        return n_;
+    };
+    while ( in < end ) {
+        unsigned const token = *in++;
+        std::size_t const ll = get_length ( token >> 4 );
+        if ( HEDLEY_UNLIKELY ( ll > static_cast<std::size_t> ( end - in ) or ll > capacity_ - o ) )
+            return 0u;
+        std::memcpy ( out + o, in, ll );
+        in += ll;
+        o += ll;
+        if ( in == end )
+            break;
+        if ( HEDLEY_UNLIKELY ( end - in < 2 ) )
+            return 0u;
+        std::size_t const off = static_cast<std::size_t> ( in[ 0 ] ) | static_cast<std::size_t> ( in[ 1 ] ) << 8;
+        in += 2;
+        std::size_t const ml = get_length ( token & 15u );
+        if ( HEDLEY_UNLIKELY ( ml == ~std::size_t{ 0 } or not off or off > o or ml + min_match > capacity_ - o ) )
+            return 0u;
+        for ( std::size_t k = 0u, n = ml + min_match; k < n; ++k, ++o ) // Byte by byte, the match may overlap.
+            out[ o ] = out[ o - off ];
+    }
+    return o;
+}
+
+} // namespace sax::lz
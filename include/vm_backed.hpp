@@ -33,9 +33,11 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 
 #include <algorithm>
 #include <initializer_list>
+#include <iterator>
 #include <memory>
 #include <new>
 #include <stdexcept>
@@ -44,8 +46,16 @@
 
 #include <hedley.hpp>
 
+#include "growth_policy.hpp"
+#include "winsys.hpp"
+
 namespace sax {
 
+// Whether a value can be moved to another address with std::memmove (and the source forgotten), specialize it
+// for types that are not trivially copyable but can be relocated all the same (f.e. most std::unique_ptr's).
+template<typename ValueType>
+struct is_trivially_relocatable : std::is_trivially_copyable<ValueType> {};
+
 template<typename ValueType, typename SizeType, SizeType Capacity>
 struct vm_array {
 
@@ -83,21 +93,80 @@ struct vm_array {
             new ( p++ ) value_type{ v };
     }
 
+    vm_array ( vm_array const & ) = delete;
+
+    // Takes over the pages of moving_, which is left without any and can only be destroyed or assigned to.
+    vm_array ( vm_array && moving_ ) noexcept :
+        m_begin ( std::exchange ( moving_.m_begin, nullptr ) ), m_end ( std::exchange ( moving_.m_end, nullptr ) ),
+        m_locked ( std::exchange ( moving_.m_locked, false ) ) {}
+
     ~vm_array ( ) {
         if constexpr ( not std::is_trivial<value_type>::value ) {
             for ( value_type & v : *this )
                 v.~value_type ( );
         }
         if ( HEDLEY_LIKELY ( m_begin ) ) {
+            unlock ( );
             VirtualFree ( m_begin, capacity_b ( ), MEM_RELEASE );
             m_end = m_begin = nullptr;
         }
     }
 
+    vm_array & operator= ( vm_array const & ) = delete;
+    [[maybe_unused]] vm_array & operator= ( vm_array && moving_ ) noexcept {
+        swap ( moving_ );
+        return *this;
+    }
+
+    void swap ( vm_array & other_ ) noexcept {
+        std::swap ( m_begin, other_.m_begin );
+        std::swap ( m_end, other_.m_end );
+        std::swap ( m_locked, other_.m_locked );
+    }
+    friend void swap ( vm_array & l_, vm_array & r_ ) noexcept { l_.swap ( r_ ); }
+
     [[nodiscard]] constexpr size_type capacity ( ) const noexcept { return Capacity; }
     [[nodiscard]] constexpr size_type size ( ) const noexcept { return capacity ( ); }
     [[nodiscard]] constexpr size_type max_size ( ) const noexcept { return capacity ( ); }
 
+    // Locked mode, the array is locked into physical memory and never paged out (the working set quota of the
+    // process is grown to make room), until unlock ( ).
+    void lock ( ) {
+        if ( not m_locked ) {
+            if ( HEDLEY_UNLIKELY ( not sax::win::lock_pages ( m_begin, capacity_b ( ) ) ) )
+                throw std::runtime_error ( "VirtualLock error: " + sax::win::last_error ( ) );
+            m_locked = true;
+        }
+    }
+    void unlock ( ) noexcept {
+        if ( m_locked ) {
+            sax::win::unlock_pages ( m_begin, capacity_b ( ) );
+            m_locked = false;
+        }
+    }
+    [[nodiscard]] bool locked ( ) const noexcept { return m_locked; }
+
+    // Residency and tiering, of the pages holding the elements [ first_, first_ + n_ ) (clipped to the size).
+    // hint_cold ( ) and page_out ( ) are the same on Windows, the pages leave the working set, their contents are
+    // kept (see sax::win::trim_pages), locked pages are left alone.
+
+    [[nodiscard]] sax::win::residency residency ( size_type const first_ = 0u, size_type const n_ = Capacity ) const noexcept {
+        auto const [ p, b ] = range_b ( first_, n_ );
+        return sax::win::query_residency ( p, b );
+    }
+    // Brings the range into physical memory ahead of a scan, with large reads instead of a fault per page.
+    void prefetch ( size_type const first_ = 0u, size_type const n_ = Capacity ) noexcept {
+        if ( auto const [ p, b ] = range_b ( first_, n_ ); b )
+            sax::win::prefetch_pages ( const_cast<pointer> ( p ), b );
+    }
+    // The range is finished with, its pages are the first to be reused when memory runs short.
+    void hint_cold ( size_type const first_ = 0u, size_type const n_ = Capacity ) noexcept { page_out ( first_, n_ ); }
+    // Takes the pages of the range out of physical memory.
+    void page_out ( size_type const first_ = 0u, size_type const n_ = Capacity ) noexcept {
+        if ( auto const [ p, b ] = range_b ( first_, n_ ); b and not m_locked )
+            sax::win::trim_pages ( const_cast<pointer> ( p ), b );
+    }
+
     [[nodiscard]] const_pointer data ( ) const noexcept { return reinterpret_cast<pointer> ( m_begin ); }
     [[nodiscard]] pointer data ( ) noexcept { return const_cast<pointer> ( std::as_const ( *this ).data ( ) ); }
 
@@ -161,10 +230,18 @@ struct vm_array {
     }
     [[nodiscard]] constexpr size_type size_b ( ) const noexcept { return capacity_b ( ); }
 
+    // The address and the length in bytes of the elements [ first_, first_ + n_ ), clipped to the size.
+    [[nodiscard]] std::pair<const_pointer, std::size_t> range_b ( size_type const first_, size_type const n_ ) const noexcept {
+        size_type const f = std::min ( first_, size ( ) ), n = std::min ( n_, static_cast<size_type> ( size ( ) - f ) );
+        return { m_begin + f, static_cast<std::size_t> ( n ) * sizeof ( value_type ) };
+    }
+
     pointer m_begin, m_end;
+    bool m_locked = false;
 };
 
-template<typename ValueType, typename SizeType, SizeType Capacity>
+template<typename ValueType, typename SizeType, SizeType Capacity,
+         typename GrowthPolicy = linear_growth_policy<SizeType, static_cast<SizeType> ( 1'600 * 65'536 )>>
 struct vm_vector {
 
     using value_type = ValueType;
@@ -197,40 +274,122 @@ struct vm_vector {
     }
 
     explicit vm_vector ( size_type const s_, value_type const & v_ ) : vm_vector{ } {
-        size_type rc = required_b ( s_ );
-        if ( HEDLEY_UNLIKELY ( not VirtualAlloc ( m_end, rc, MEM_COMMIT, PAGE_READWRITE ) ) )
-            throw std::bad_alloc ( );
-        m_committed_b = rc;
+        commit ( required_b ( s_ ) );
         for ( pointer e = m_begin + std::min ( s_, capacity ( ) ); m_end < e; ++m_end )
             new ( m_end ) value_type{ v_ };
     }
 
+    vm_vector ( vm_vector const & ) = delete;
+
+    // Takes over the pages of moving_, which is left without any and can only be destroyed or assigned to.
+    vm_vector ( vm_vector && moving_ ) noexcept :
+        m_begin ( std::exchange ( moving_.m_begin, nullptr ) ), m_end ( std::exchange ( moving_.m_end, nullptr ) ),
+        m_committed_b ( std::exchange ( moving_.m_committed_b, 0u ) ), m_locked_b ( std::exchange ( moving_.m_locked_b, 0u ) ),
+        m_locked ( std::exchange ( moving_.m_locked, false ) ) {}
+
     ~vm_vector ( ) {
         if constexpr ( not std::is_trivial<value_type>::value ) {
             for ( value_type & v : *this )
                 v.~value_type ( );
         }
         if ( HEDLEY_LIKELY ( m_begin ) ) {
+            unlock ( );
             VirtualFree ( m_begin, capacity_b ( ), MEM_RELEASE );
             m_end = m_begin = nullptr;
             m_committed_b   = 0u;
         }
     }
 
+    vm_vector & operator= ( vm_vector const & ) = delete;
+    [[maybe_unused]] vm_vector & operator= ( vm_vector && moving_ ) noexcept {
+        swap ( moving_ );
+        return *this;
+    }
+
+    void swap ( vm_vector & other_ ) noexcept {
+        std::swap ( m_begin, other_.m_begin );
+        std::swap ( m_end, other_.m_end );
+        std::swap ( m_committed_b, other_.m_committed_b );
+        std::swap ( m_locked_b, other_.m_locked_b );
+        std::swap ( m_locked, other_.m_locked );
+    }
+    friend void swap ( vm_vector & l_, vm_vector & r_ ) noexcept { l_.swap ( r_ ); }
+
     [[nodiscard]] constexpr size_type capacity ( ) const noexcept { return Capacity; }
     [[nodiscard]] size_type size ( ) const noexcept {
         return reinterpret_cast<value_type *> ( m_end ) - reinterpret_cast<value_type *> ( m_begin );
     }
     [[nodiscard]] constexpr size_type max_size ( ) const noexcept { return capacity ( ); }
+    [[nodiscard]] size_type committed ( ) const noexcept { return m_committed_b / sizeof ( value_type ); }
+
+    // Commits the pages required to hold n_ elements (capped at the capacity), without changing the size.
+    void reserve ( size_type const n_ ) {
+        size_type const rb = std::min ( required_b ( n_ ), capacity_b ( ) );
+        if ( rb > m_committed_b )
+            commit ( rb );
+    }
+
+    // Locked mode, the committed pages, and from now on every page committed, are locked into physical memory
+    // and never paged out (the working set quota of the process is grown to make room), until unlock ( ).
+    void lock ( ) {
+        if ( not m_locked ) {
+            try {
+                lock_committed ( );
+            }
+            catch ( ... ) {
+                unlock ( ); // Hands back whatever was locked, the vector stays unlocked.
+                throw;
+            }
+            m_locked = true;
+        }
+    }
+    void unlock ( ) noexcept {
+        if ( m_locked_b )
+            sax::win::unlock_pages ( m_begin, m_locked_b );
+        m_locked_b = 0u;
+        m_locked   = false;
+    }
+    [[nodiscard]] bool locked ( ) const noexcept { return m_locked; }
+
+    // Residency and tiering, of the pages holding the elements [ first_, first_ + n_ ) (clipped to the size).
+    // hint_cold ( ) and page_out ( ) are the same on Windows, the pages leave the working set, their contents are
+    // kept (see sax::win::trim_pages), locked pages are left alone.
+
+    [[nodiscard]] sax::win::residency residency ( size_type const first_ = 0u, size_type const n_ = Capacity ) const noexcept {
+        auto const [ p, b ] = range_b ( first_, n_ );
+        return sax::win::query_residency ( p, b );
+    }
+    // Brings the range into physical memory ahead of a scan, with large reads instead of a fault per page.
+    void prefetch ( size_type const first_ = 0u, size_type const n_ = Capacity ) noexcept {
+        if ( auto const [ p, b ] = range_b ( first_, n_ ); b )
+            sax::win::prefetch_pages ( const_cast<pointer> ( p ), b );
+    }
+    // The range is finished with, its pages are the first to be reused when memory runs short.
+    void hint_cold ( size_type const first_ = 0u, size_type const n_ = Capacity ) noexcept { page_out ( first_, n_ ); }
+    // Takes the pages of the range out of physical memory.
+    void page_out ( size_type const first_ = 0u, size_type const n_ = Capacity ) noexcept {
+        if ( auto const [ p, b ] = range_b ( first_, n_ ); b and not m_locked )
+            sax::win::trim_pages ( const_cast<pointer> ( p ), b );
+    }
+
+    // Grows the size by n_ elements without constructing them, returns a pointer to the first one. Meant for
+    // filling the vector in place, f.e. straight from a file (see vm_io.hpp).
+    [[maybe_unused]] pointer append_uninitialized ( size_type const n_ ) {
+        static_assert ( std::is_trivially_copyable<value_type>::value, "append_uninitialized requires a trivially copyable type" );
+        if ( HEDLEY_UNLIKELY ( n_ > capacity ( ) - size ( ) ) )
+            throw std::bad_alloc ( );
+        reserve ( size ( ) + n_ );
+        pointer p = m_end;
+        m_end += n_;
+        return p;
+    }
 
     template<typename... Args>
     [[maybe_unused]] reference emplace_back ( Args &&... value_ ) {
         if ( HEDLEY_UNLIKELY ( size_b ( ) == m_committed_b ) ) {
-            size_type cib = std::min ( m_committed_b ? grow ( m_committed_b ) : allocation_page_size_b, capacity_b ( ) );
-            std::cout << ( cib / allocation_page_size_b * 100 ) << " MB" << nl;
-            if ( HEDLEY_UNLIKELY ( not VirtualAlloc ( m_end, cib - m_committed_b, MEM_COMMIT, PAGE_READWRITE ) ) )
-                throw std::bad_alloc ( );
-            m_committed_b = cib;
+            size_type cib =
+                std::min ( m_committed_b ? GrowthPolicy::grow ( m_committed_b ) : allocation_page_size_b, capacity_b ( ) );
+            commit ( cib );
         }
         return *new ( m_end++ ) value_type{ std::forward<Args> ( value_ )... };
     }
@@ -244,6 +403,53 @@ struct vm_vector {
         --m_end;
     }
 
+    // Destroys the elements, the pages stay committed (and locked) for reuse.
+    void clear ( ) noexcept {
+        if constexpr ( not std::is_trivial<value_type>::value ) {
+            for ( value_type & v : *this )
+                v.~value_type ( );
+        }
+        m_end = m_begin;
+    }
+
+    // Inserts [ first_, last_ ) before pos_, returns an iterator to the first element inserted. The pages are
+    // committed in place, so the elements after pos_ are shifted up with a single std::memmove if the type is
+    // trivially relocatable, and rotated into place otherwise.
+    template<typename ForwardIt>
+    [[maybe_unused]] iterator insert ( const_iterator const pos_, ForwardIt const first_, ForwardIt const last_ ) {
+        return insert_n ( pos_, static_cast<size_type> ( std::distance ( first_, last_ ) ),
+                          [ & ] ( pointer const p_ ) { std::uninitialized_copy ( first_, last_, p_ ); } );
+    }
+    [[maybe_unused]] iterator insert ( const_iterator const pos_, size_type const n_, const_reference v_ ) {
+        value_type const v{ v_ }; // v_ might be an element.
+        return insert_n ( pos_, n_, [ & ] ( pointer const p_ ) { std::uninitialized_fill_n ( p_, n_, v ); } );
+    }
+    [[maybe_unused]] iterator insert ( const_iterator const pos_, const_reference v_ ) { return insert ( pos_, 1u, v_ ); }
+
+    // Erases [ first_, last_ ), returns an iterator to the element that followed the last one erased.
+    [[maybe_unused]] iterator erase ( const_iterator const first_, const_iterator const last_ ) noexcept ( nothrow_erase ) {
+        pointer const f = const_cast<pointer> ( first_ ), l = const_cast<pointer> ( last_ );
+        if ( f == l )
+            return f;
+        if constexpr ( is_trivially_relocatable<value_type>::value ) {
+            if constexpr ( not std::is_trivially_destructible<value_type>::value ) {
+                for ( pointer q = f; q < l; ++q )
+                    q->~value_type ( );
+            }
+            std::memmove ( f, l, static_cast<std::size_t> ( m_end - l ) * sizeof ( value_type ) );
+            m_end -= l - f;
+        }
+        else {
+            pointer const e = std::move ( l, m_end, f );
+            while ( m_end != e )
+                pop_back ( );
+        }
+        return f;
+    }
+    [[maybe_unused]] iterator erase ( const_iterator const pos_ ) noexcept ( noexcept ( erase ( pos_, pos_ + 1 ) ) ) {
+        return erase ( pos_, pos_ + 1 );
+    }
+
     [[nodiscard]] const_pointer data ( ) const noexcept { return reinterpret_cast<pointer> ( m_begin ); }
     [[nodiscard]] pointer data ( ) noexcept { return const_cast<pointer> ( std::as_const ( *this ).data ( ) ); }
 
@@ -302,6 +508,10 @@ struct vm_vector {
     static constexpr size_type page_size_b            = static_cast<size_type> ( 65'536 );         // 64KB
     static constexpr size_type allocation_page_size_b = static_cast<size_type> ( 1'600 * 65'536 ); // 100MB
 
+    // Erasing moves the tail down, bitwise or by move assignment.
+    static constexpr bool nothrow_erase =
+        is_trivially_relocatable<value_type>::value or std::is_nothrow_move_assignable<value_type>::value;
+
     [[nodiscard]] size_type required_b ( size_type const & r_ ) const noexcept {
         std::size_t req = r_ * sizeof ( value_type );
         return req % page_size_b ? ( ( req + page_size_b ) / page_size_b ) * page_size_b : req;
@@ -314,11 +524,61 @@ struct vm_vector {
         return reinterpret_cast<char *> ( m_end ) - reinterpret_cast<char *> ( m_begin );
     }
 
-    [[nodiscard]] static size_type grow ( size_type const & cap_b_ ) noexcept { return cap_b_ + allocation_page_size_b; }
-    [[nodiscard]] static size_type shrink ( size_type const & cap_b_ ) noexcept { return cap_b_ - allocation_page_size_b; }
+    // The address and the length in bytes of the elements [ first_, first_ + n_ ), clipped to the size.
+    [[nodiscard]] std::pair<const_pointer, std::size_t> range_b ( size_type const first_, size_type const n_ ) const noexcept {
+        size_type const f = std::min ( first_, size ( ) ), n = std::min ( n_, static_cast<size_type> ( size ( ) - f ) );
+        return { m_begin + f, static_cast<std::size_t> ( n ) * sizeof ( value_type ) };
+    }
+
+    // Constructs n_ elements with construct_ ( p ) in the gap opened at pos_.
+    template<typename Construct>
+    [[nodiscard]] iterator insert_n ( const_iterator const pos_, size_type const n_, Construct && construct_ ) {
+        size_type const i = static_cast<size_type> ( pos_ - m_begin );
+        if ( HEDLEY_UNLIKELY ( n_ > capacity ( ) - size ( ) ) )
+            throw std::bad_alloc ( );
+        reserve ( size ( ) + n_ );
+        pointer const p = m_begin + i;
+        if constexpr ( is_trivially_relocatable<value_type>::value ) {
+            std::memmove ( p + n_, p, static_cast<std::size_t> ( m_end - p ) * sizeof ( value_type ) );
+            try {
+                construct_ ( p );
+            }
+            catch ( ... ) {
+                std::memmove ( p, p + n_, static_cast<std::size_t> ( m_end - p ) * sizeof ( value_type ) );
+                throw;
+            }
+            m_end += n_;
+        }
+        else {
+            construct_ ( m_end );
+            m_end += n_;
+            std::rotate ( p, m_end - n_, m_end );
+        }
+        return p;
+    }
+
+    // Commits up to rb_ bytes, in locked mode the new pages are locked as well.
+    void commit ( size_type const rb_ ) {
+        if ( HEDLEY_UNLIKELY ( not VirtualAlloc ( reinterpret_cast<char *> ( m_begin ) + m_committed_b, rb_ - m_committed_b,
+                                                  MEM_COMMIT, PAGE_READWRITE ) ) )
+            throw std::bad_alloc ( );
+        m_committed_b = rb_;
+        if ( m_locked )
+            lock_committed ( );
+    }
+    void lock_committed ( ) {
+        if ( m_locked_b < m_committed_b ) {
+            if ( HEDLEY_UNLIKELY (
+                     not sax::win::lock_pages ( reinterpret_cast<char *> ( m_begin ) + m_locked_b, m_committed_b - m_locked_b ) ) )
+                throw std::runtime_error ( "VirtualLock error: " + sax::win::last_error ( ) );
+            m_locked_b = m_committed_b;
+        }
+    }
 
     pointer m_begin, m_end;
     size_type m_committed_b;
+    size_type m_locked_b = 0u;
+    bool m_locked        = false;
 };
 
 } // namespace sax
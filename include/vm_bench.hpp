@@ -0,0 +1,331 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef NOMINMAX
+#    define NOMINMAX
+#endif
+
+#include <Memoryapi.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <plf/plf_nanotimer.h>
+
+#include <hedley.hpp>
+
+#include "winsys.hpp"
+
+// A memory bus speed benchmark along the lines of Roy Longbottom's BusSpeed: read, write and copy bandwidth and
+// the latency of a random pointer chase, over working sets from L1 size up to multiple GB, in 64KB (normal) or
+// large pages, on one thread or spread over several.
+//
+// The buffers are allocated the way vm_array allocates, reserved and committed in one go, and touched before
+// timing, so faults are not measured. Windows has no transparent huge pages, large pages (which require
+// SeLockMemoryPrivilege) are the only huge page mode, pages::large is skipped where it cannot be allocated.
+
+namespace sax::bench {
+
+enum class test { read, write, copy, latency };
+enum class pages { normal, large };
+
+[[nodiscard]] constexpr char const * name ( test const t_ ) noexcept {
+    switch ( t_ ) {
+        case test::read: return "read";
+        case test::write: return "write";
+        case test::copy: return "copy";
+        default: return "latency";
+    }
+}
+[[nodiscard]] constexpr char const * name ( pages const p_ ) noexcept { return p_ == pages::normal ? "normal" : "large"; }
+
+// A committed, page-aligned buffer of (at least) size_b_ bytes.
+struct buffer {
+
+    buffer ( std::size_t const size_b_, pages const pages_ ) : m_pages{ pages_ } {
+        if ( pages_ == pages::large ) {
+            std::size_t const lp = sax::win::large_page_minimum ( );
+            if ( HEDLEY_UNLIKELY ( not lp or not sax::win::lock_memory_privilege ( ) ) )
+                throw std::runtime_error ( "large pages are not available" );
+            m_size_b = ( ( size_b_ + lp - 1u ) / lp ) * lp;
+            m_data   = VirtualAlloc ( nullptr, m_size_b, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE );
+        }
+        else {
+            m_size_b = ( ( size_b_ + 65'535u ) / 65'536u ) * 65'536u;
+            m_data   = VirtualAlloc ( nullptr, m_size_b, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+        }
+        if ( HEDLEY_UNLIKELY ( not m_data ) )
+            throw std::bad_alloc ( );
+        std::memset ( m_data, 0, m_size_b ); // Fault it in.
+    }
+
+    buffer ( buffer const & )             = delete;
+    buffer & operator= ( buffer const & ) = delete;
+
+    ~buffer ( ) noexcept {
+        if ( HEDLEY_LIKELY ( m_data ) )
+            VirtualFree ( m_data, 0u, MEM_RELEASE );
+    }
+
+    [[nodiscard]] char * data ( ) const noexcept { return static_cast<char *> ( m_data ); }
+    [[nodiscard]] std::size_t size_b ( ) const noexcept { return m_size_b; }
+    [[nodiscard]] pages page_mode ( ) const noexcept { return m_pages; }
+
+    private:
+    void * m_data = nullptr;
+    std::size_t m_size_b;
+    pages m_pages;
+};
+
+struct config {
+    std::size_t min_b = 16'384u;        // Smallest working set.
+    std::size_t max_b = 1'073'741'824u; // Largest working set (1GB), sizes double from min_b.
+    std::vector<unsigned> threads{ 1u, std::max ( std::thread::hardware_concurrency ( ), 1u ) };
+    std::vector<pages> page_modes{ pages::normal, pages::large };
+    std::vector<test> tests{ test::read, test::write, test::copy, test::latency };
+    std::size_t traffic_b = 268'435'456u; // Bytes (or, for latency, loads * 64) moved per trial, at least.
+    int trials            = 3;            // The best trial is reported.
+};
+
+struct result {
+    test kind;
+    pages page_mode;
+    std::size_t size_b; // The working set of all threads together.
+    unsigned threads;
+    double mb_per_s;    // Bandwidth, for latency the 64 byte lines loaded per second.
+    double ns_per_load; // Latency, for the bandwidth tests the time per 8 byte word moved (per thread).
+};
+
+namespace detail {
+
+inline constexpr std::size_t line_b = 64u;
+
+[[nodiscard]] inline std::uint64_t read ( std::uint64_t const * p_, std::size_t const n_ ) noexcept {
+    std::uint64_t a = 0u, b = 0u, c = 0u, d = 0u;
+    for ( std::size_t i = 0u; i < n_; i += 4u ) {
+        a += p_[ i ];
+        b += p_[ i + 1u ];
+        c += p_[ i + 2u ];
+        d += p_[ i + 3u ];
+    }
+    return a + b + c + d;
+}
+
+inline void write ( std::uint64_t * p_, std::size_t const n_, std::uint64_t const v_ ) noexcept {
+    for ( std::size_t i = 0u; i < n_; i += 4u ) {
+        p_[ i ]      = v_;
+        p_[ i + 1u ] = v_;
+        p_[ i + 2u ] = v_;
+        p_[ i + 3u ] = v_;
+    }
+}
+
+// Links the lines of [ p_, p_ + size_b_ ) into a single cycle in random order (Sattolo), so that the
+// prefetchers cannot follow the chase.
+inline void link ( char * const p_, std::size_t const size_b_, std::uint64_t const seed_ ) {
+    std::size_t const n = size_b_ / line_b;
+    std::vector<std::uint32_t> order ( n );
+    for ( std::size_t i = 0u; i < n; ++i )
+        order[ i ] = static_cast<std::uint32_t> ( i );
+    std::mt19937_64 rng{ seed_ };
+    for ( std::size_t i = n - 1u; i > 0u; --i )
+        std::swap ( order[ i ], order[ std::uniform_int_distribution<std::size_t>{ 0u, i - 1u }( rng ) ] );
+    for ( std::size_t i = 0u; i < n; ++i )
+        *reinterpret_cast<void **> ( p_ + order[ i ] * line_b ) = p_ + order[ ( i + 1u ) % n ] * line_b;
+}
+
+[[nodiscard]] inline void * chase ( void * p_, std::size_t n_ ) noexcept {
+    for ( ; n_ >= 4u; n_ -= 4u )
+        p_ = *static_cast<void **> ( *static_cast<void **> ( *static_cast<void **> ( *static_cast<void **> ( p_ ) ) ) );
+    for ( ; n_; --n_ )
+        p_ = *static_cast<void **> ( p_ );
+    return p_;
+}
+
+inline std::uint64_t volatile sink = 0u;
+
+// Runs passes_ passes of t_ over the slice [ p_, p_ + slice_b_ ), returns the elapsed time in ns.
+[[nodiscard]] inline double run ( test const t_, char * const p_, std::size_t const slice_b_, std::size_t const passes_ ) noexcept {
+    plf::nanotimer timer;
+    std::uint64_t s = 0u;
+    switch ( t_ ) {
+        case test::read: {
+            timer.start ( );
+            for ( std::size_t i = 0u; i < passes_; ++i )
+                s += read ( reinterpret_cast<std::uint64_t const *> ( p_ ), slice_b_ / 8u );
+        } break;
+        case test::write: {
+            timer.start ( );
+            for ( std::size_t i = 0u; i < passes_; ++i )
+                write ( reinterpret_cast<std::uint64_t *> ( p_ ), slice_b_ / 8u, i );
+        } break;
+        case test::copy: {
+            std::size_t const h = slice_b_ / 2u;
+            timer.start ( );
+            for ( std::size_t i = 0u; i < passes_; ++i )
+                std::memcpy ( p_ + ( i & 1u ? 0u : h ), p_ + ( i & 1u ? h : 0u ), h );
+        } break;
+        default: {
+            void * q = p_;
+            timer.start ( );
+            q = chase ( q, passes_ );
+            s = reinterpret_cast<std::uintptr_t> ( q );
+        }
+    }
+    double const ns = timer.get_elapsed_ns ( );
+    sink            = sink + s;
+    return ns;
+}
+
+// Lines the threads up at the start of a trial, reusable. The threads spin (they are about to run flat out
+// anyway), so they leave the gate within a wake-up of one another.
+struct start_gate {
+
+    explicit start_gate ( unsigned const n_ ) noexcept : m_n{ n_ } {}
+
+    void arrive_and_wait ( ) noexcept {
+        unsigned const g = m_generation.load ( std::memory_order_acquire );
+        if ( m_arrived.fetch_add ( 1u, std::memory_order_acq_rel ) + 1u == m_n ) {
+            m_arrived.store ( 0u, std::memory_order_relaxed );
+            m_generation.store ( g + 1u, std::memory_order_release ); // The last one in opens the gate.
+            return;
+        }
+        while ( m_generation.load ( std::memory_order_acquire ) == g )
+            std::this_thread::yield ( );
+    }
+
+    private:
+    std::atomic<unsigned> m_arrived{ 0u }, m_generation{ 0u };
+    unsigned const m_n;
+};
+
+} // namespace detail
+
+// Measures t_ over the first size_b_ bytes of b_, split evenly over threads_ threads.
+[[nodiscard]] inline result measure ( buffer & b_, test const t_, std::size_t const size_b_, unsigned const threads_,
+                                      config const & c_ = config{ } ) {
+    assert ( size_b_ <= b_.size_b ( ) and threads_ );
+    std::size_t const slice_b =
+        std::max<std::size_t> ( ( size_b_ / threads_ ) / detail::line_b * detail::line_b, 2u * detail::line_b );
+    if ( t_ == test::latency ) {
+        for ( unsigned t = 0u; t < threads_; ++t )
+            detail::link ( b_.data ( ) + t * slice_b, slice_b, t + 1u );
+    }
+    std::size_t const moved_b = t_ == test::latency ? detail::line_b : t_ == test::copy ? slice_b / 2u : slice_b;
+    std::size_t const passes  = std::max<std::size_t> ( c_.traffic_b / threads_ / moved_b, 1u );
+    std::vector<double> ns ( static_cast<std::size_t> ( c_.trials ) * threads_ );
+    auto const work = [ & ] ( unsigned const t_i_, detail::start_gate * const sync_ ) noexcept {
+        for ( int r = 0; r < c_.trials; ++r ) {
+            if ( sync_ )
+                sync_->arrive_and_wait ( );
+            ns[ static_cast<std::size_t> ( r ) * threads_ + t_i_ ] =
+                detail::run ( t_, b_.data ( ) + t_i_ * slice_b, slice_b, passes );
+        }
+    };
+    if ( threads_ == 1u ) {
+        work ( 0u, nullptr );
+    }
+    else {
+        detail::start_gate sync{ threads_ };
+        std::vector<std::thread> pool;
+        pool.reserve ( threads_ );
+        for ( unsigned t = 0u; t < threads_; ++t )
+            pool.emplace_back ( work, t, std::addressof ( sync ) );
+        for ( std::thread & t : pool )
+            t.join ( );
+    }
+    double best = std::numeric_limits<double>::max ( ); // The slowest thread of the fastest trial.
+    for ( int r = 0; r < c_.trials; ++r )
+        best = std::min ( best, *std::max_element ( ns.data ( ) + static_cast<std::size_t> ( r ) * threads_,
+                                                    ns.data ( ) + static_cast<std::size_t> ( r + 1 ) * threads_ ) );
+    double const total_b = static_cast<double> ( moved_b ) * static_cast<double> ( passes ) * threads_;
+    double const words   = t_ == test::latency ? static_cast<double> ( passes ) : static_cast<double> ( moved_b / 8u * passes );
+    return { t_, b_.page_mode ( ), slice_b * threads_, threads_, total_b * 1'000.0 / best, best / words };
+}
+
+// Runs all tests of c_ over all sizes, thread counts and page modes, page modes that cannot be allocated are
+// skipped.
+[[nodiscard]] inline std::vector<result> run ( config const & c_ = config{ } ) {
+    std::vector<result> results;
+    for ( pages const p : c_.page_modes ) {
+        std::size_t max_b = c_.max_b;
+        std::unique_ptr<buffer> b;
+        while ( not b and max_b >= c_.min_b ) {
+            try {
+                b = std::make_unique<buffer> ( max_b, p );
+            }
+            catch ( std::bad_alloc const & ) {
+                max_b /= 2u; // Fall back to what fits.
+            }
+            catch ( std::runtime_error const & ) {
+                break; // No privilege, no large pages.
+            }
+        }
+        if ( not b )
+            continue;
+        for ( unsigned const t : c_.threads ) {
+            for ( std::size_t s = c_.min_b; s <= max_b; s *= 2u ) {
+                for ( test const k : c_.tests )
+                    results.push_back ( measure ( *b, k, s, t, c_ ) );
+            }
+        }
+    }
+    return results;
+}
+
+inline void write_csv ( std::ostream & out_, std::vector<result> const & r_ ) {
+    out_ << "test,pages,size_b,threads,mb_per_s,ns_per_load\n";
+    for ( result const & r : r_ )
+        out_ << name ( r.kind ) << ',' << name ( r.page_mode ) << ',' << r.size_b << ',' << r.threads << ',' << r.mb_per_s << ','
+             << r.ns_per_load << '\n';
+}
+
+inline void write_json ( std::ostream & out_, std::vector<result> const & r_ ) {
+    out_ << "[\n";
+    for ( std::size_t i = 0u; i < r_.size ( ); ++i ) {
+        result const & r = r_[ i ];
+        out_ << "  { \"test\": \"" << name ( r.kind ) << "\", \"pages\": \"" << name ( r.page_mode )
+             << "\", \"size_b\": " << r.size_b << ", \"threads\": " << r.threads << ", \"mb_per_s\": " << r.mb_per_s
+             << ", \"ns_per_load\": " << r.ns_per_load << ( i + 1u < r_.size ( ) ? " },\n" : " }\n" );
+    }
+    out_ << "]\n";
+}
+
+} // namespace sax::bench
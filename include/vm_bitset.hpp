@@ -0,0 +1,600 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef NOMINMAX
+#    define NOMINMAX
+#endif
+
+#include <Memoryapi.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <immintrin.h>
+
+#include <hedley.hpp>
+
+#include "bit_ops.hpp"
+#include "vm_simd.hpp"
+
+// Word kernels (popcount, bitwise and/or/xor/andnot, find the first non-zero word) over arrays of
+// std::uint64_t, in the instruction set namespaces of vm_simd.hpp and dispatched the same way. The AVX-512
+// popcount requires VPOPCNTDQ, without it the AVX2 (nibble lookup) version is used.
+
+namespace sax::simd {
+
+enum class bitwise : int { and_, or_, xor_, andnot }; // d = d op s, andnot is d & ~s.
+
+template<bitwise Op>
+[[nodiscard]] constexpr std::uint64_t apply_bitwise ( std::uint64_t const d_, std::uint64_t const s_ ) noexcept {
+    if constexpr ( Op == bitwise::and_ )
+        return d_ & s_;
+    else if constexpr ( Op == bitwise::or_ )
+        return d_ | s_;
+    else if constexpr ( Op == bitwise::xor_ )
+        return d_ ^ s_;
+    else
+        return d_ & ~s_;
+}
+
+namespace scalar {
+
+[[nodiscard]] inline std::uint64_t popcount_words ( std::uint64_t const * p_, std::size_t const n_ ) noexcept {
+    std::uint64_t c0 = 0u, c1 = 0u;
+    std::size_t i = 0u;
+    for ( ; i + 2u <= n_; i += 2u ) {
+        c0 += static_cast<std::uint64_t> ( sax::popcount ( p_[ i ] ) );
+        c1 += static_cast<std::uint64_t> ( sax::popcount ( p_[ i + 1u ] ) );
+    }
+    if ( i < n_ )
+        c0 += static_cast<std::uint64_t> ( sax::popcount ( p_[ i ] ) );
+    return c0 + c1;
+}
+
+template<bitwise Op>
+void bitwise_words ( std::uint64_t * d_, std::uint64_t const * s_, std::size_t const n_ ) noexcept {
+    for ( std::size_t i = 0u; i < n_; ++i )
+        d_[ i ] = apply_bitwise<Op> ( d_[ i ], s_[ i ] );
+}
+
+[[nodiscard]] inline std::size_t find_nonzero_word ( std::uint64_t const * p_, std::size_t const n_ ) noexcept {
+    for ( std::size_t i = 0u; i < n_; ++i ) {
+        if ( p_[ i ] )
+            return i;
+    }
+    return n_;
+}
+
+} // namespace scalar
+
+// AVX2.
+
+#if defined( __clang__ )
+#    pragma clang attribute push( __attribute__( ( target( "avx2,bmi,bmi2,popcnt,lzcnt" ) ) ), apply_to = function )
+#elif defined( __GNUC__ )
+#    pragma GCC push_options
+#    pragma GCC target( "avx2,bmi,bmi2,popcnt,lzcnt" )
+#endif
+
+namespace avx2 {
+
+// Per byte popcount, two nibble lookups (Mula).
+[[nodiscard]] inline __m256i popcount_epi8 ( __m256i const v_ ) noexcept {
+    __m256i const lookup =
+        _mm256_setr_epi8 ( 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 );
+    __m256i const low = _mm256_set1_epi8 ( 0x0f );
+    return _mm256_add_epi8 ( _mm256_shuffle_epi8 ( lookup, _mm256_and_si256 ( v_, low ) ),
+                             _mm256_shuffle_epi8 ( lookup, _mm256_and_si256 ( _mm256_srli_epi16 ( v_, 4 ), low ) ) );
+}
+
+[[nodiscard]] inline std::uint64_t popcount_words ( std::uint64_t const * p_, std::size_t const n_ ) noexcept {
+    __m256i acc   = _mm256_setzero_si256 ( );
+    std::size_t i = 0u;
+    for ( ; i + 4u <= n_; i += 4u )
+        acc = _mm256_add_epi64 (
+            acc, _mm256_sad_epu8 ( popcount_epi8 ( _mm256_loadu_si256 ( reinterpret_cast<__m256i const *> ( p_ + i ) ) ),
+                                   _mm256_setzero_si256 ( ) ) );
+    alignas ( 32 ) std::uint64_t t[ 4 ];
+    _mm256_store_si256 ( reinterpret_cast<__m256i *> ( t ), acc );
+    return t[ 0 ] + t[ 1 ] + t[ 2 ] + t[ 3 ] + scalar::popcount_words ( p_ + i, n_ - i );
+}
+
+template<bitwise Op>
+[[nodiscard]] __m256i apply_bitwise ( __m256i const d_, __m256i const s_ ) noexcept {
+    if constexpr ( Op == bitwise::and_ )
+        return _mm256_and_si256 ( d_, s_ );
+    else if constexpr ( Op == bitwise::or_ )
+        return _mm256_or_si256 ( d_, s_ );
+    else if constexpr ( Op == bitwise::xor_ )
+        return _mm256_xor_si256 ( d_, s_ );
+    else
+        return _mm256_andnot_si256 ( s_, d_ );
+}
+
+template<bitwise Op>
+void bitwise_words ( std::uint64_t * d_, std::uint64_t const * s_, std::size_t const n_ ) noexcept {
+    std::size_t i = 0u;
+    for ( ; i + 4u <= n_; i += 4u ) {
+        __m256i * const d = reinterpret_cast<__m256i *> ( d_ + i );
+        _mm256_storeu_si256 ( d, apply_bitwise<Op> ( _mm256_loadu_si256 ( d ),
+                                                     _mm256_loadu_si256 ( reinterpret_cast<__m256i const *> ( s_ + i ) ) ) );
+    }
+    scalar::bitwise_words<Op> ( d_ + i, s_ + i, n_ - i );
+}
+
+[[nodiscard]] inline std::size_t find_nonzero_word ( std::uint64_t const * p_, std::size_t const n_ ) noexcept {
+    std::size_t i = 0u;
+    for ( ; i + 4u <= n_; i += 4u ) {
+        __m256i const v = _mm256_loadu_si256 ( reinterpret_cast<__m256i const *> ( p_ + i ) );
+        if ( HEDLEY_UNLIKELY ( not _mm256_testz_si256 ( v, v ) ) )
+            return i + scalar::find_nonzero_word ( p_ + i, 4u );
+    }
+    return i + scalar::find_nonzero_word ( p_ + i, n_ - i );
+}
+
+} // namespace avx2
+
+#if defined( __clang__ )
+#    pragma clang attribute pop
+#elif defined( __GNUC__ )
+#    pragma GCC pop_options
+#endif
+
+// AVX-512 (F, VPOPCNTDQ for popcount_words).
+
+#if defined( __clang__ )
+#    pragma clang attribute push( __attribute__( ( target( "avx512f,avx512vpopcntdq,avx2,bmi,bmi2,popcnt,lzcnt" ) ) ),             \
+                                  apply_to = function )
+#elif defined( __GNUC__ )
+#    pragma GCC push_options
+#    pragma GCC target( "avx512f,avx512vpopcntdq,avx2,bmi,bmi2,popcnt,lzcnt" )
+#endif
+
+namespace avx512 {
+
+[[nodiscard]] inline std::uint64_t popcount_words ( std::uint64_t const * p_, std::size_t const n_ ) noexcept {
+    __m512i a0 = _mm512_setzero_si512 ( ), a1 = _mm512_setzero_si512 ( );
+    std::size_t i = 0u;
+    for ( ; i + 16u <= n_; i += 16u ) {
+        a0 = _mm512_add_epi64 ( a0, _mm512_popcnt_epi64 ( _mm512_loadu_si512 ( p_ + i ) ) );
+        a1 = _mm512_add_epi64 ( a1, _mm512_popcnt_epi64 ( _mm512_loadu_si512 ( p_ + i + 8u ) ) );
+    }
+    return static_cast<std::uint64_t> ( _mm512_reduce_add_epi64 ( _mm512_add_epi64 ( a0, a1 ) ) ) +
+           scalar::popcount_words ( p_ + i, n_ - i );
+}
+
+template<bitwise Op>
+[[nodiscard]] __m512i apply_bitwise ( __m512i const d_, __m512i const s_ ) noexcept {
+    if constexpr ( Op == bitwise::and_ )
+        return _mm512_and_si512 ( d_, s_ );
+    else if constexpr ( Op == bitwise::or_ )
+        return _mm512_or_si512 ( d_, s_ );
+    else if constexpr ( Op == bitwise::xor_ )
+        return _mm512_xor_si512 ( d_, s_ );
+    else
+        return _mm512_andnot_si512 ( s_, d_ );
+}
+
+template<bitwise Op>
+void bitwise_words ( std::uint64_t * d_, std::uint64_t const * s_, std::size_t const n_ ) noexcept {
+    std::size_t i = 0u;
+    for ( ; i + 8u <= n_; i += 8u )
+        _mm512_storeu_si512 ( d_ + i, apply_bitwise<Op> ( _mm512_loadu_si512 ( d_ + i ), _mm512_loadu_si512 ( s_ + i ) ) );
+    scalar::bitwise_words<Op> ( d_ + i, s_ + i, n_ - i );
+}
+
+[[nodiscard]] inline std::size_t find_nonzero_word ( std::uint64_t const * p_, std::size_t const n_ ) noexcept {
+    std::size_t i = 0u;
+    for ( ; i + 8u <= n_; i += 8u ) {
+        __m512i const v = _mm512_loadu_si512 ( p_ + i );
+        if ( __mmask8 const m = _mm512_test_epi64_mask ( v, v ); HEDLEY_UNLIKELY ( m ) )
+            return i + static_cast<std::size_t> ( sax::countr_zero ( static_cast<unsigned> ( m ) ) );
+    }
+    return i + scalar::find_nonzero_word ( p_ + i, n_ - i );
+}
+
+} // namespace avx512
+
+#if defined( __clang__ )
+#    pragma clang attribute pop
+#elif defined( __GNUC__ )
+#    pragma GCC pop_options
+#endif
+
+// Dispatch.
+
+[[nodiscard]] inline std::uint64_t popcount_words ( std::uint64_t const * p_, std::size_t const n_ ) noexcept {
+    if ( cpu_isa == isa::avx512 and cpu.avx512vpopcntdq )
+        return avx512::popcount_words ( p_, n_ );
+    if ( cpu_isa != isa::scalar )
+        return avx2::popcount_words ( p_, n_ );
+    return scalar::popcount_words ( p_, n_ );
+}
+
+template<bitwise Op>
+void bitwise_words ( std::uint64_t * d_, std::uint64_t const * s_, std::size_t const n_ ) noexcept {
+    switch ( cpu_isa ) {
+        case isa::avx512: return avx512::bitwise_words<Op> ( d_, s_, n_ );
+        case isa::avx2: return avx2::bitwise_words<Op> ( d_, s_, n_ );
+        default: return scalar::bitwise_words<Op> ( d_, s_, n_ );
+    }
+}
+
+// Index of the first non-zero word, n_ if none.
+[[nodiscard]] inline std::size_t find_nonzero_word ( std::uint64_t const * p_, std::size_t const n_ ) noexcept {
+    switch ( cpu_isa ) {
+        case isa::avx512: return avx512::find_nonzero_word ( p_, n_ );
+        case isa::avx2: return avx2::find_nonzero_word ( p_, n_ );
+        default: return scalar::find_nonzero_word ( p_, n_ );
+    }
+}
+
+} // namespace sax::simd
+
+namespace sax {
+
+// Bitset of Capacity bits in a reserved range, committed a 64KB chunk (524'288 bits) at a time when a bit in
+// it is first set. Reading a bit in an uncommitted chunk returns false without touching (committing) it,
+// scans and bulk operations skip uncommitted chunks.
+//
+// The rank/select directory (a popcount per chunk and per 512-bit block) is built the first time rank ( ) or
+// select ( ) is called and then brought up to date incrementally: modifications mark their chunk dirty and
+// only dirty chunks are recounted. Its memory is reserved up front, but only committed when used.
+
+template<typename SizeType, SizeType Capacity>
+struct vm_bitset {
+
+    using size_type = SizeType;
+    using word_type = std::uint64_t;
+
+    static constexpr size_type page_size_b = static_cast<size_type> ( 65'536 ); // 64KB
+    static constexpr size_type chunk_bits  = page_size_b * 8u;
+    static constexpr size_type chunk_words = page_size_b / sizeof ( word_type );
+    static constexpr size_type chunk_count = ( Capacity + chunk_bits - 1u ) / chunk_bits;
+
+    static constexpr size_type block_words  = 8u; // 512 bits, a cache line.
+    static constexpr size_type chunk_blocks = chunk_words / block_words;
+
+    static constexpr size_type npos = Capacity;
+
+    vm_bitset ( ) {
+        std::size_t const chunks = static_cast<std::size_t> ( chunk_count );
+
+        try {
+            m_words      = reserve_impl<word_type> ( chunks * chunk_words, MEM_RESERVE );
+            m_committed  = reserve_impl<word_type> ( map_words, MEM_RESERVE | MEM_COMMIT );
+            m_dirty      = reserve_impl<word_type> ( map_words, MEM_RESERVE | MEM_COMMIT );
+            m_chunk_rank = reserve_impl<std::uint64_t> ( chunks + 1u, MEM_RESERVE | MEM_COMMIT );
+            m_chunk_pop  = reserve_impl<std::uint32_t> ( chunks, MEM_RESERVE | MEM_COMMIT );
+            m_block_rank = reserve_impl<std::uint32_t> ( chunks * chunk_blocks, MEM_RESERVE );
+        }
+        catch ( ... ) {
+            release ( );
+            throw;
+        }
+    }
+
+    vm_bitset ( vm_bitset const & )             = delete;
+    vm_bitset & operator= ( vm_bitset const & ) = delete;
+
+    ~vm_bitset ( ) { release ( ); }
+
+    // Size.
+
+    [[nodiscard]] static constexpr size_type size ( ) noexcept { return Capacity; }
+    [[nodiscard]] size_type committed_chunks ( ) const noexcept { return m_committed_chunks; }
+    [[nodiscard]] bool chunk_committed ( size_type const c_ ) const noexcept { return map_test ( m_committed, c_ ); }
+
+    // Bit access.
+
+    [[nodiscard]] bool test ( size_type const i_ ) const noexcept {
+        assert ( i_ < size ( ) );
+        return chunk_committed ( i_ / chunk_bits ) and ( m_words[ i_ >> 6 ] >> ( i_ & 63u ) & 1u );
+    }
+    [[nodiscard]] bool operator[] ( size_type const i_ ) const noexcept { return test ( i_ ); }
+
+    [[maybe_unused]] vm_bitset & set ( size_type const i_ ) {
+        assert ( i_ < size ( ) );
+        size_type const c = i_ / chunk_bits;
+        if ( HEDLEY_UNLIKELY ( not chunk_committed ( c ) ) )
+            commit_chunk ( c );
+        m_words[ i_ >> 6 ] |= word_type{ 1u } << ( i_ & 63u );
+        map_set ( m_dirty, c );
+        return *this;
+    }
+    [[maybe_unused]] vm_bitset & set ( size_type const i_, bool const v_ ) { return v_ ? set ( i_ ) : reset ( i_ ); }
+
+    [[maybe_unused]] vm_bitset & reset ( size_type const i_ ) noexcept {
+        assert ( i_ < size ( ) );
+        size_type const c = i_ / chunk_bits;
+        if ( chunk_committed ( c ) ) {
+            m_words[ i_ >> 6 ] &= ~( word_type{ 1u } << ( i_ & 63u ) );
+            map_set ( m_dirty, c );
+        }
+        return *this;
+    }
+
+    [[maybe_unused]] vm_bitset & flip ( size_type const i_ ) {
+        assert ( i_ < size ( ) );
+        size_type const c = i_ / chunk_bits;
+        if ( HEDLEY_UNLIKELY ( not chunk_committed ( c ) ) )
+            commit_chunk ( c );
+        m_words[ i_ >> 6 ] ^= word_type{ 1u } << ( i_ & 63u );
+        map_set ( m_dirty, c );
+        return *this;
+    }
+
+    // Clears all bits, decommitting all chunks.
+    [[maybe_unused]] vm_bitset & reset ( ) noexcept {
+        for_each_committed ( [ this ] ( size_type const c_ ) noexcept { decommit_chunk ( c_ ); } );
+        return *this;
+    }
+
+    // Decommits the committed chunks that have no bit set.
+    void shrink_to_fit ( ) noexcept {
+        for_each_committed ( [ this ] ( size_type const c_ ) noexcept {
+            if ( simd::find_nonzero_word ( chunk ( c_ ), chunk_words ) == chunk_words )
+                decommit_chunk ( c_ );
+        } );
+    }
+
+    // Queries.
+
+    [[nodiscard]] size_type count ( ) const noexcept {
+        std::uint64_t c = 0u;
+        for_each_committed (
+            [ this, &c ] ( size_type const c_ ) noexcept { c += simd::popcount_words ( chunk ( c_ ), chunk_words ); } );
+        return static_cast<size_type> ( c );
+    }
+
+    [[nodiscard]] size_type find_first ( ) const noexcept { return find_from ( 0u ); }
+    // The first set bit after i_, npos if none.
+    [[nodiscard]] size_type find_next ( size_type const i_ ) const noexcept {
+        return i_ + 1u < size ( ) ? find_from ( i_ + 1u ) : npos;
+    }
+
+    [[nodiscard]] bool any ( ) const noexcept { return find_first ( ) != npos; }
+    [[nodiscard]] bool none ( ) const noexcept { return not any ( ); }
+
+    // Bulk operations.
+
+    [[maybe_unused]] vm_bitset & operator&= ( vm_bitset const & o_ ) noexcept {
+        for_each_committed ( [ this, &o_ ] ( size_type const c_ ) noexcept {
+            if ( o_.chunk_committed ( c_ ) ) {
+                simd::bitwise_words<simd::bitwise::and_> ( chunk ( c_ ), o_.chunk ( c_ ), chunk_words );
+                map_set ( m_dirty, c_ );
+            }
+            else {
+                decommit_chunk ( c_ );
+            }
+        } );
+        return *this;
+    }
+    [[maybe_unused]] vm_bitset & operator|= ( vm_bitset const & o_ ) { return combine<simd::bitwise::or_> ( o_ ); }
+    [[maybe_unused]] vm_bitset & operator^= ( vm_bitset const & o_ ) { return combine<simd::bitwise::xor_> ( o_ ); }
+    // *this &= ~o_.
+    [[maybe_unused]] vm_bitset & and_not ( vm_bitset const & o_ ) noexcept {
+        for_each_committed ( [ this, &o_ ] ( size_type const c_ ) noexcept {
+            if ( o_.chunk_committed ( c_ ) ) {
+                simd::bitwise_words<simd::bitwise::andnot> ( chunk ( c_ ), o_.chunk ( c_ ), chunk_words );
+                map_set ( m_dirty, c_ );
+            }
+        } );
+        return *this;
+    }
+
+    // Rank/select.
+
+    // Number of set bits in [ 0, i_ ), i_ <= size ( ).
+    [[nodiscard]] size_type rank ( size_type const i_ ) const {
+        assert ( i_ <= size ( ) );
+        update_directory ( );
+        size_type const c = i_ / chunk_bits;
+        std::uint64_t r   = m_chunk_rank[ c ];
+        if ( c < chunk_count and chunk_committed ( c ) ) {
+            size_type const w = ( i_ % chunk_bits ) >> 6, b = w / block_words;
+            word_type const * const p = chunk ( c );
+            r += m_block_rank[ c * chunk_blocks + b ];
+            r += scalar_popcount ( p + b * block_words, w - b * block_words );
+            if ( i_ & 63u )
+                r += static_cast<std::uint64_t> ( sax::popcount ( p[ w ] & ( ~word_type{ 0u } >> ( 64u - ( i_ & 63u ) ) ) ) );
+        }
+        return static_cast<size_type> ( r );
+    }
+
+    // Position of the k_-th (from 0) set bit, npos if there are not that many.
+    [[nodiscard]] size_type select ( size_type k_ ) const {
+        update_directory ( );
+        std::uint64_t const k = static_cast<std::uint64_t> ( k_ );
+        if ( k >= m_chunk_rank[ chunk_count ] )
+            return npos;
+        std::uint64_t const * const cr = std::upper_bound ( m_chunk_rank, m_chunk_rank + chunk_count + 1u, k );
+        size_type const c              = static_cast<size_type> ( cr - m_chunk_rank - 1 );
+        k_ -= static_cast<size_type> ( m_chunk_rank[ c ] );
+        std::uint32_t const * const br = m_block_rank + c * chunk_blocks;
+        size_type const b =
+            static_cast<size_type> ( std::upper_bound ( br, br + chunk_blocks, static_cast<std::uint32_t> ( k_ ) ) - br - 1 );
+        k_ -= br[ b ];
+        word_type const * p = chunk ( c ) + b * block_words;
+        for ( ;; ++p ) {
+            size_type const n = static_cast<size_type> ( sax::popcount ( *p ) );
+            if ( k_ < n )
+                break;
+            k_ -= n;
+        }
+        word_type w = *p;
+        for ( ; k_; --k_ )
+            w &= w - 1u;
+        return static_cast<size_type> ( ( p - m_words ) * 64 + sax::countr_zero ( w ) );
+    }
+
+    private:
+    static constexpr std::size_t map_words = ( chunk_count + 63u ) / 64u; // Words in the per-chunk bitmaps.
+
+    void release ( ) noexcept {
+        for ( void * p :
+              { static_cast<void *> ( m_words ), static_cast<void *> ( m_committed ), static_cast<void *> ( m_dirty ),
+                static_cast<void *> ( m_chunk_rank ), static_cast<void *> ( m_chunk_pop ), static_cast<void *> ( m_block_rank ) } )
+            if ( HEDLEY_LIKELY ( p ) )
+                VirtualFree ( p, 0u, MEM_RELEASE );
+        m_words      = nullptr;
+        m_committed  = nullptr;
+        m_dirty      = nullptr;
+        m_chunk_rank = nullptr;
+        m_chunk_pop  = nullptr;
+        m_block_rank = nullptr;
+    }
+
+    template<typename T>
+    [[nodiscard]] static T * reserve_impl ( std::size_t const n_, DWORD const type_ ) {
+        void * p = VirtualAlloc ( nullptr, n_ * sizeof ( T ), type_, PAGE_READWRITE );
+        if ( HEDLEY_UNLIKELY ( not p ) )
+            throw std::bad_alloc ( );
+        return static_cast<T *> ( p );
+    }
+
+    [[nodiscard]] static bool map_test ( word_type const * m_, size_type const c_ ) noexcept {
+        return m_[ c_ >> 6 ] >> ( c_ & 63u ) & 1u;
+    }
+    static void map_set ( word_type * m_, size_type const c_ ) noexcept { m_[ c_ >> 6 ] |= word_type{ 1u } << ( c_ & 63u ); }
+    static void map_reset ( word_type * m_, size_type const c_ ) noexcept { m_[ c_ >> 6 ] &= ~( word_type{ 1u } << ( c_ & 63u ) ); }
+
+    [[nodiscard]] static std::uint64_t scalar_popcount ( word_type const * p_, size_type const n_ ) noexcept {
+        std::uint64_t r = 0u;
+        for ( size_type i = 0u; i < n_; ++i )
+            r += static_cast<std::uint64_t> ( sax::popcount ( p_[ i ] ) );
+        return r;
+    }
+
+    [[nodiscard]] word_type * chunk ( size_type const c_ ) const noexcept {
+        return m_words + static_cast<std::size_t> ( c_ ) * chunk_words;
+    }
+
+    template<typename Function>
+    void for_each_committed ( Function f_ ) const {
+        for ( std::size_t w = 0u; w < map_words; ++w ) {
+            for ( word_type b = m_committed[ w ]; b; b &= b - 1u )
+                f_ ( static_cast<size_type> ( w * 64u + sax::countr_zero ( b ) ) );
+        }
+    }
+
+    void commit_chunk ( size_type const c_ ) {
+        if ( HEDLEY_UNLIKELY ( not VirtualAlloc ( chunk ( c_ ), page_size_b, MEM_COMMIT, PAGE_READWRITE ) ) )
+            throw std::bad_alloc ( );
+        map_set ( m_committed, c_ );
+        ++m_committed_chunks;
+    }
+
+    void decommit_chunk ( size_type const c_ ) noexcept {
+        VirtualFree ( chunk ( c_ ), page_size_b, MEM_DECOMMIT );
+        map_reset ( m_committed, c_ );
+        map_set ( m_dirty, c_ );
+        --m_committed_chunks;
+    }
+
+    template<simd::bitwise Op>
+    [[maybe_unused]] vm_bitset & combine ( vm_bitset const & o_ ) {
+        o_.for_each_committed ( [ this, &o_ ] ( size_type const c_ ) {
+            if ( not chunk_committed ( c_ ) )
+                commit_chunk ( c_ );
+            simd::bitwise_words<Op> ( chunk ( c_ ), o_.chunk ( c_ ), chunk_words );
+            map_set ( m_dirty, c_ );
+        } );
+        return *this;
+    }
+
+    [[nodiscard]] size_type find_from ( size_type const i_ ) const noexcept {
+        size_type c = i_ / chunk_bits;
+        if ( chunk_committed ( c ) ) {
+            // The remainder of the word holding i_, then the remainder of its chunk.
+            size_type const w = i_ >> 6;
+            if ( word_type const b = m_words[ w ] >> ( i_ & 63u ) )
+                return i_ + static_cast<size_type> ( sax::countr_zero ( b ) );
+            size_type const end = ( c + 1u ) * chunk_words;
+            if ( size_type const n = static_cast<size_type> ( simd::find_nonzero_word ( m_words + w + 1u, end - w - 1u ) );
+                 n < end - w - 1u )
+                return ( w + 1u + n ) * 64u + static_cast<size_type> ( sax::countr_zero ( m_words[ w + 1u + n ] ) );
+        }
+        // The committed chunks that follow.
+        for ( ++c; c < chunk_count; ++c ) {
+            word_type const b = m_committed[ c >> 6 ] >> ( c & 63u );
+            if ( not b ) {
+                c = ( ( c >> 6 ) + 1u ) * 64u - 1u;
+                continue;
+            }
+            c += static_cast<size_type> ( sax::countr_zero ( b ) );
+            if ( c >= chunk_count )
+                break;
+            word_type const * const p = chunk ( c );
+            if ( size_type const n = static_cast<size_type> ( simd::find_nonzero_word ( p, chunk_words ) ); n < chunk_words )
+                return c * chunk_bits + n * 64u + static_cast<size_type> ( sax::countr_zero ( p[ n ] ) );
+        }
+        return npos;
+    }
+
+    // Recounts the dirty chunks and the chunk prefix sums from the first dirty chunk on.
+    void update_directory ( ) const {
+        std::size_t first = chunk_count;
+        for ( std::size_t w = 0u; w < map_words; ++w ) {
+            for ( word_type b = m_dirty[ w ]; b; b &= b - 1u ) {
+                size_type const c        = static_cast<size_type> ( w * 64u + sax::countr_zero ( b ) );
+                first                    = std::min<std::size_t> ( first, c );
+                std::uint32_t * const br = m_block_rank + c * chunk_blocks;
+                std::uint32_t r          = 0u;
+                if ( chunk_committed ( c ) ) {
+                    if ( HEDLEY_UNLIKELY (
+                             not VirtualAlloc ( br, chunk_blocks * sizeof ( std::uint32_t ), MEM_COMMIT, PAGE_READWRITE ) ) )
+                        throw std::bad_alloc ( );
+                    word_type const * const p = chunk ( c );
+                    for ( size_type i = 0u; i < chunk_blocks; ++i ) {
+                        br[ i ] = r;
+                        r += static_cast<std::uint32_t> ( scalar_popcount ( p + i * block_words, block_words ) );
+                    }
+                }
+                m_chunk_pop[ c ] = r;
+            }
+            m_dirty[ w ] = 0u;
+        }
+        for ( std::size_t c = first; c < chunk_count; ++c )
+            m_chunk_rank[ c + 1u ] = m_chunk_rank[ c ] + m_chunk_pop[ c ];
+    }
+
+    word_type * m_words          = nullptr;
+    word_type * m_committed      = nullptr; // Bitmap of committed chunks.
+    word_type * m_dirty          = nullptr; // Bitmap of chunks modified since the directory was updated.
+    std::uint64_t * m_chunk_rank = nullptr; // Set bits before each chunk, chunk_count + 1 entries.
+    std::uint32_t * m_chunk_pop  = nullptr; // Set bits in each chunk.
+    std::uint32_t * m_block_rank = nullptr; // Set bits before each block in its chunk.
+    size_type m_committed_chunks = 0u;
+};
+
+} // namespace sax
@@ -0,0 +1,633 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef NOMINMAX
+#    define NOMINMAX
+#endif
+
+#include <Memoryapi.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <hedley.hpp>
+
+#include "bit_ops.hpp"
+#include "vm_simd.hpp"
+
+namespace sax {
+
+// Ordered map (B+tree) with its nodes in one reserved region. A node is NodeSizeB bytes, a whole number of
+// system pages and at most the 64KB allocation granularity, nodes are addressed by 32-bit ids (the offset in
+// the region in nodes). A node is committed when allocated and decommitted when freed, its id goes on a free
+// list for reuse. Keys and values are stored in separate arrays in the node, the in-node search narrows down
+// with a binary search and finishes with a SIMD count of the keys less than the key (for the key types of
+// vm_simd.hpp, ordered by std::less). The leaves are linked for iteration.
+//
+// Keys and values are trivially copyable, entries are moved within and between nodes with memmove.
+
+template<typename Key, typename Value, typename SizeType, SizeType Capacity, typename Compare = std::less<Key>,
+         std::size_t NodeSizeB = 4'096>
+struct vm_btree_map {
+
+    static_assert ( std::is_trivially_copyable<Key>::value and std::is_trivially_copyable<Value>::value,
+                    "vm_btree_map requires trivially copyable keys and values" );
+    static_assert ( NodeSizeB >= 4'096u and NodeSizeB <= 65'536u and sax::has_single_bit ( NodeSizeB ),
+                    "the node size must be a power of 2 from 4KB up to 64KB" );
+
+    using key_type    = Key;
+    using mapped_type = Value;
+    using key_compare = Compare;
+
+    using size_type       = SizeType;
+    using difference_type = std::make_signed_t<size_type>;
+
+    using node_id = std::uint32_t;
+
+    static constexpr node_id nil = ~node_id{ 0u };
+
+    static constexpr std::size_t node_size_b = NodeSizeB;
+
+    private:
+    struct header {
+        std::uint32_t count; // Entries in a leaf, keys in an inner node.
+        std::uint32_t leaf;
+        node_id next, prev; // Leaves only.
+    };
+
+    [[nodiscard]] static constexpr std::size_t round_up ( std::size_t const n_, std::size_t const a_ ) noexcept {
+        return ( n_ + a_ - 1u ) / a_ * a_;
+    }
+
+    public:
+    static constexpr std::size_t leaf_capacity =
+        ( node_size_b - sizeof ( header ) - alignof ( Value ) ) / ( sizeof ( Key ) + sizeof ( Value ) );
+    static constexpr std::size_t inner_capacity = // Keys, an inner node has one child more.
+        ( node_size_b - sizeof ( header ) - alignof ( node_id ) - sizeof ( node_id ) ) / ( sizeof ( Key ) + sizeof ( node_id ) );
+
+    // Nodes are at least half full (the root excepted), nodes reserved accordingly.
+    static constexpr std::size_t max_nodes = 4u * ( static_cast<std::size_t> ( Capacity ) / leaf_capacity + 1u ) + 16u;
+
+    static_assert ( leaf_capacity >= 4u and inner_capacity >= 4u, "vm_btree_map entries too large for the node size" );
+    static_assert ( max_nodes < nil, "vm_btree_map node ids are 32-bit" );
+
+    // Iteration.
+
+    template<bool Const>
+    struct iterator_impl {
+
+        using mapped_reference = std::conditional_t<Const, Value const &, Value &>;
+
+        struct reference {
+            Key const & first;
+            mapped_reference second;
+        };
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = reference;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = void;
+
+        using map_pointer = std::conditional_t<Const, vm_btree_map const *, vm_btree_map *>;
+
+        iterator_impl ( ) noexcept = default;
+        iterator_impl ( map_pointer m_, node_id const n_, std::uint32_t const i_ ) noexcept :
+            m_map{ m_ }, m_node{ n_ }, m_index{ i_ } {}
+        // Conversion to const_iterator.
+        template<bool C = Const, typename = std::enable_if_t<C>>
+        iterator_impl ( iterator_impl<false> const & it_ ) noexcept :
+            m_map{ it_.m_map }, m_node{ it_.m_node }, m_index{ it_.m_index } {}
+
+        [[nodiscard]] reference operator* ( ) const noexcept { return { key ( ), value ( ) }; }
+        [[nodiscard]] Key const & key ( ) const noexcept { return m_map->keys ( m_node )[ m_index ]; }
+        [[nodiscard]] mapped_reference value ( ) const noexcept { return m_map->values ( m_node )[ m_index ]; }
+
+        [[maybe_unused]] iterator_impl & operator++ ( ) noexcept {
+            if ( ++m_index == m_map->hdr ( m_node ).count ) {
+                m_node  = m_map->hdr ( m_node ).next;
+                m_index = 0u;
+            }
+            return *this;
+        }
+        [[maybe_unused]] iterator_impl operator++ ( int ) noexcept {
+            iterator_impl tmp{ *this };
+            ++*this;
+            return tmp;
+        }
+
+        [[nodiscard]] bool operator== ( iterator_impl const & r_ ) const noexcept {
+            return m_node == r_.m_node and m_index == r_.m_index;
+        }
+        [[nodiscard]] bool operator!= ( iterator_impl const & r_ ) const noexcept { return not operator== ( r_ ); }
+
+        private:
+        friend struct vm_btree_map;
+        friend struct iterator_impl<true>;
+
+        map_pointer m_map     = nullptr;
+        node_id m_node        = nil;
+        std::uint32_t m_index = 0u;
+    };
+
+    using iterator       = iterator_impl<false>;
+    using const_iterator = iterator_impl<true>;
+
+    explicit vm_btree_map ( Compare const & c_ = Compare{ } ) :
+        m_nodes{ reinterpret_cast<char *> ( VirtualAlloc ( nullptr, max_nodes * node_size_b, MEM_RESERVE, PAGE_READWRITE ) ) },
+        m_compare{ c_ } {
+        if ( HEDLEY_UNLIKELY ( not m_nodes ) )
+            throw std::bad_alloc ( );
+        m_root = allocate_node ( true );
+    }
+
+    vm_btree_map ( vm_btree_map const & )             = delete;
+    vm_btree_map & operator= ( vm_btree_map const & ) = delete;
+
+    ~vm_btree_map ( ) {
+        if ( HEDLEY_LIKELY ( m_nodes ) ) {
+            VirtualFree ( m_nodes, 0u, MEM_RELEASE );
+            m_nodes = nullptr;
+        }
+    }
+
+    // Size.
+
+    [[nodiscard]] static constexpr size_type capacity ( ) noexcept { return Capacity; }
+    [[nodiscard]] static constexpr size_type max_size ( ) noexcept { return capacity ( ); }
+    [[nodiscard]] size_type size ( ) const noexcept { return m_size; }
+    [[nodiscard]] bool empty ( ) const noexcept { return not m_size; }
+    [[nodiscard]] std::size_t height ( ) const noexcept { return m_height; }
+    [[nodiscard]] std::size_t node_count ( ) const noexcept { return m_next - m_free.size ( ); } // Committed nodes.
+
+    // Iterators.
+
+    [[nodiscard]] const_iterator begin ( ) const noexcept { return m_size ? const_iterator{ this, first_leaf ( ), 0u } : end ( ); }
+    [[nodiscard]] const_iterator cbegin ( ) const noexcept { return begin ( ); }
+    [[nodiscard]] iterator begin ( ) noexcept { return m_size ? iterator{ this, first_leaf ( ), 0u } : end ( ); }
+
+    [[nodiscard]] const_iterator end ( ) const noexcept { return { this, nil, 0u }; }
+    [[nodiscard]] const_iterator cend ( ) const noexcept { return end ( ); }
+    [[nodiscard]] iterator end ( ) noexcept { return { this, nil, 0u }; }
+
+    // Lookup.
+
+    // The first entry with a key not less than k_.
+    [[nodiscard]] const_iterator lower_bound ( Key const & k_ ) const noexcept {
+        node_id n = m_root;
+        for ( std::size_t h = 1u; h < m_height; ++h )
+            n = children ( n )[ rank<true> ( keys ( n ), hdr ( n ).count, k_ ) ];
+        std::uint32_t const i = static_cast<std::uint32_t> ( rank<false> ( keys ( n ), hdr ( n ).count, k_ ) );
+        if ( i < hdr ( n ).count )
+            return { this, n, i };
+        return { this, hdr ( n ).next, 0u }; // The next leaf is not empty, or nil.
+    }
+    [[nodiscard]] iterator lower_bound ( Key const & k_ ) noexcept {
+        return unconst ( std::as_const ( *this ).lower_bound ( k_ ) );
+    }
+
+    [[nodiscard]] const_iterator find ( Key const & k_ ) const noexcept {
+        const_iterator it = lower_bound ( k_ );
+        return it != end ( ) and not m_compare ( k_, it.key ( ) ) ? it : end ( );
+    }
+    [[nodiscard]] iterator find ( Key const & k_ ) noexcept { return unconst ( std::as_const ( *this ).find ( k_ ) ); }
+
+    [[nodiscard]] bool contains ( Key const & k_ ) const noexcept { return find ( k_ ) != end ( ); }
+
+    [[nodiscard]] Value const & at ( Key const & k_ ) const {
+        if ( const_iterator it = find ( k_ ); HEDLEY_LIKELY ( it != end ( ) ) )
+            return it.value ( );
+        else
+            throw std::runtime_error ( "vm_btree_map: key not found" );
+    }
+    [[nodiscard]] Value & at ( Key const & k_ ) { return const_cast<Value &> ( std::as_const ( *this ).at ( k_ ) ); }
+
+    // Inserts a value-initialized value if k_ is not present (like std::map).
+    [[nodiscard]] Value & operator[] ( Key const & k_ ) { return insert ( k_, Value{ } ).first.value ( ); }
+
+    // Modify.
+
+    // Inserts ( k_, v_ ) if k_ is not present, returns the entry with key k_ and whether it was inserted.
+    [[maybe_unused]] std::pair<iterator, bool> insert ( Key const & k_, Value const & v_ ) {
+        path p;
+        node_id n             = descend ( k_, p );
+        std::uint32_t const c = hdr ( n ).count;
+        std::uint32_t i       = static_cast<std::uint32_t> ( rank<false> ( keys ( n ), c, k_ ) );
+        if ( i < c and not m_compare ( k_, keys ( n )[ i ] ) )
+            return { iterator{ this, n, i }, false };
+        if ( HEDLEY_UNLIKELY ( m_size == Capacity ) )
+            throw std::bad_alloc ( );
+        if ( c == leaf_capacity ) {
+            // Split, the upper half goes to a new right sibling.
+            node_id const r       = allocate_node ( true );
+            std::uint32_t const h = static_cast<std::uint32_t> ( ( leaf_capacity + 1u ) / 2u );
+            move_entries ( r, 0u, n, h, c - h );
+            hdr ( r ).count = c - h;
+            hdr ( n ).count = h;
+            hdr ( r ).next  = hdr ( n ).next;
+            hdr ( r ).prev  = n;
+            if ( hdr ( n ).next != nil )
+                hdr ( hdr ( n ).next ).prev = r;
+            hdr ( n ).next = r;
+            insert_inner ( p, m_height - 1u, keys ( r )[ 0 ], r );
+            if ( i > h ) {
+                n = r;
+                i -= h;
+            }
+        }
+        header & hn = hdr ( n );
+        move_entries ( n, i + 1u, n, i, hn.count - i );
+        keys ( n )[ i ]   = k_;
+        values ( n )[ i ] = v_;
+        ++hn.count;
+        ++m_size;
+        return { iterator{ this, n, i }, true };
+    }
+
+    [[maybe_unused]] std::pair<iterator, bool> insert_or_assign ( Key const & k_, Value const & v_ ) {
+        std::pair<iterator, bool> r = insert ( k_, v_ );
+        if ( not r.second )
+            r.first.value ( ) = v_;
+        return r;
+    }
+
+    // Removes the entry with key k_, returns the number of entries removed.
+    [[maybe_unused]] size_type erase ( Key const & k_ ) noexcept {
+        path p;
+        node_id const n       = descend ( k_, p );
+        std::uint32_t const c = hdr ( n ).count;
+        std::uint32_t const i = static_cast<std::uint32_t> ( rank<false> ( keys ( n ), c, k_ ) );
+        if ( i == c or m_compare ( k_, keys ( n )[ i ] ) )
+            return 0u;
+        move_entries ( n, i, n, i + 1u, c - i - 1u );
+        --hdr ( n ).count;
+        --m_size;
+        rebalance ( p, n );
+        return 1u;
+    }
+
+    // Removes all entries, all nodes but the root are decommitted.
+    void clear ( ) noexcept {
+        VirtualFree ( m_nodes, m_next * node_size_b, MEM_DECOMMIT );
+        m_free.clear ( );
+        m_next   = 0u;
+        m_size   = 0u;
+        m_height = 1u;
+        m_root   = allocate_node ( true );
+    }
+
+    // Builds the map from the sorted (strictly increasing keys) entries of c_, f.e. a vm_vector of pairs,
+    // leaves filled to fill_ of their capacity. The map must be empty.
+    template<typename Container>
+    void bulk_load ( Container const & c_, float const fill_ = 1.0f ) {
+        bulk_load_impl (
+            static_cast<std::size_t> ( std::size ( c_ ) ),
+            [ &c_ ] ( std::size_t const i_ ) noexcept -> Key const & { return c_[ i_ ].first; },
+            [ &c_ ] ( std::size_t const i_ ) noexcept -> Value const & { return c_[ i_ ].second; }, fill_ );
+    }
+    // As above, keys and values in separate (equally sized) containers.
+    template<typename KeyContainer, typename ValueContainer>
+    void bulk_load ( KeyContainer const & k_, ValueContainer const & v_, float const fill_ = 1.0f ) {
+        assert ( std::size ( k_ ) == std::size ( v_ ) );
+        bulk_load_impl (
+            static_cast<std::size_t> ( std::size ( k_ ) ),
+            [ &k_ ] ( std::size_t const i_ ) noexcept -> Key const & { return k_[ i_ ]; },
+            [ &v_ ] ( std::size_t const i_ ) noexcept -> Value const & { return v_[ i_ ]; }, fill_ );
+    }
+
+    private:
+    static constexpr std::size_t max_height = 16u;
+
+    static constexpr std::size_t values_offset = round_up ( sizeof ( header ) + leaf_capacity * sizeof ( Key ), alignof ( Value ) );
+    static constexpr std::size_t children_offset =
+        round_up ( sizeof ( header ) + inner_capacity * sizeof ( Key ), alignof ( node_id ) );
+
+    static constexpr std::size_t leaf_min  = leaf_capacity / 2u;
+    static constexpr std::size_t inner_min = inner_capacity / 2u;
+
+    static constexpr bool simd_search =
+        simd::is_vectorized<Key> and ( std::is_same<Compare, std::less<Key>>::value or std::is_same<Compare, std::less<>>::value );
+    static constexpr std::size_t search_window = 64u; // Keys, the remainder of the search is a SIMD count.
+
+    // The inner nodes from the root down to the parent of the leaf, with the index of the child taken.
+    using path = std::array<std::pair<node_id, std::uint32_t>, max_height>;
+
+    [[nodiscard]] char * node ( node_id const n_ ) const noexcept {
+        return m_nodes + static_cast<std::size_t> ( n_ ) * node_size_b;
+    }
+    [[nodiscard]] header & hdr ( node_id const n_ ) const noexcept { return *reinterpret_cast<header *> ( node ( n_ ) ); }
+    [[nodiscard]] Key * keys ( node_id const n_ ) const noexcept {
+        return reinterpret_cast<Key *> ( node ( n_ ) + sizeof ( header ) );
+    }
+    [[nodiscard]] Value * values ( node_id const n_ ) const noexcept {
+        return reinterpret_cast<Value *> ( node ( n_ ) + values_offset );
+    }
+    [[nodiscard]] node_id * children ( node_id const n_ ) const noexcept {
+        return reinterpret_cast<node_id *> ( node ( n_ ) + children_offset );
+    }
+
+    [[nodiscard]] iterator unconst ( const_iterator const & it_ ) noexcept { return { this, it_.m_node, it_.m_index }; }
+
+    [[nodiscard]] node_id first_leaf ( ) const noexcept {
+        node_id n = m_root;
+        for ( std::size_t h = 1u; h < m_height; ++h )
+            n = children ( n )[ 0 ];
+        return n;
+    }
+
+    // The number of keys in keys_[ 0, n_ ) less than (Upper: not greater than) k_.
+    template<bool Upper>
+    [[nodiscard]] std::size_t rank ( Key const * keys_, std::size_t const n_, Key const & k_ ) const noexcept {
+        auto before = [ this, &k_ ] ( Key const & x_ ) noexcept { return Upper ? not m_compare ( k_, x_ ) : m_compare ( x_, k_ ); };
+        std::size_t lo = 0u, len = n_;
+        while ( len > ( simd_search ? search_window : 0u ) ) {
+            std::size_t const half = len / 2u;
+            if ( before ( keys_[ lo + half ] ) ) {
+                lo += half + 1u;
+                len -= half + 1u;
+            }
+            else {
+                len = half;
+            }
+        }
+        if constexpr ( simd_search )
+            return lo + simd::count_if ( keys_ + lo, len, Upper ? simd::less_equal ( k_ ) : simd::less ( k_ ) );
+        else
+            return lo;
+    }
+
+    [[nodiscard]] node_id descend ( Key const & k_, path & p_ ) const noexcept {
+        node_id n = m_root;
+        for ( std::size_t h = 0u; h + 1u < m_height; ++h ) {
+            std::uint32_t const c = static_cast<std::uint32_t> ( rank<true> ( keys ( n ), hdr ( n ).count, k_ ) );
+            p_[ h ]               = { n, c };
+            n                     = children ( n )[ c ];
+        }
+        return n;
+    }
+
+    [[nodiscard]] node_id allocate_node ( bool const leaf_ ) {
+        node_id n;
+        if ( m_free.size ( ) ) {
+            n = m_free.back ( );
+            m_free.pop_back ( );
+        }
+        else {
+            if ( HEDLEY_UNLIKELY ( m_next == max_nodes ) )
+                throw std::bad_alloc ( );
+            n = m_next++;
+        }
+        if ( HEDLEY_UNLIKELY ( not VirtualAlloc ( node ( n ), node_size_b, MEM_COMMIT, PAGE_READWRITE ) ) ) {
+            m_free.push_back ( n );
+            throw std::bad_alloc ( );
+        }
+        hdr ( n ) = header{ 0u, leaf_, nil, nil };
+        return n;
+    }
+
+    void free_node ( node_id const n_ ) noexcept {
+        VirtualFree ( node ( n_ ), node_size_b, MEM_DECOMMIT );
+        m_free.push_back ( n_ );
+    }
+
+    // Leaf entries, the ranges may overlap.
+    void move_entries ( node_id const d_, std::size_t const di_, node_id const s_, std::size_t const si_,
+                        std::size_t const n_ ) noexcept {
+        std::memmove ( keys ( d_ ) + di_, keys ( s_ ) + si_, n_ * sizeof ( Key ) );
+        std::memmove ( values ( d_ ) + di_, values ( s_ ) + si_, n_ * sizeof ( Value ) );
+    }
+    // Inner node keys and children, the ranges may overlap.
+    void move_keys ( node_id const d_, std::size_t const di_, node_id const s_, std::size_t const si_,
+                     std::size_t const n_ ) noexcept {
+        std::memmove ( keys ( d_ ) + di_, keys ( s_ ) + si_, n_ * sizeof ( Key ) );
+    }
+    void move_children ( node_id const d_, std::size_t const di_, node_id const s_, std::size_t const si_,
+                         std::size_t const n_ ) noexcept {
+        std::memmove ( children ( d_ ) + di_, children ( s_ ) + si_, n_ * sizeof ( node_id ) );
+    }
+
+    // Inserts separator k_ and its right child r_ into the inner node at path level h_ (into a new root if h_
+    // is 0 and that is the root that split), splitting as required.
+    void insert_inner ( path & p_, std::size_t h_, Key k_, node_id r_ ) {
+        while ( h_-- ) {
+            auto [ n, i ]         = p_[ h_ ];
+            std::uint32_t const c = hdr ( n ).count;
+            if ( c < inner_capacity ) {
+                move_keys ( n, i + 1u, n, i, c - i );
+                move_children ( n, i + 2u, n, i + 1u, c - i );
+                keys ( n )[ i ]          = k_;
+                children ( n )[ i + 1u ] = r_;
+                ++hdr ( n ).count;
+                return;
+            }
+            // Split around the middle key, which moves up.
+            node_id const s       = allocate_node ( false );
+            std::uint32_t const m = c / 2u;
+            Key const up          = keys ( n )[ m ];
+            move_keys ( s, 0u, n, m + 1u, c - m - 1u );
+            move_children ( s, 0u, n, m + 1u, c - m );
+            hdr ( s ).count       = c - m - 1u;
+            hdr ( n ).count       = m;
+            node_id const t       = i <= m ? n : s;
+            std::uint32_t const j = i <= m ? i : i - m - 1u, tc = hdr ( t ).count;
+            move_keys ( t, j + 1u, t, j, tc - j );
+            move_children ( t, j + 2u, t, j + 1u, tc - j );
+            keys ( t )[ j ]          = k_;
+            children ( t )[ j + 1u ] = r_;
+            ++hdr ( t ).count;
+            k_ = up;
+            r_ = s;
+        }
+        // The root split.
+        node_id const root     = allocate_node ( false );
+        keys ( root )[ 0 ]     = k_;
+        children ( root )[ 0 ] = m_root;
+        children ( root )[ 1 ] = r_;
+        hdr ( root ).count     = 1u;
+        m_root                 = root;
+        ++m_height;
+    }
+
+    // Restores the minimum fill of n_ (a leaf) and its ancestors by borrowing from or merging with a sibling.
+    void rebalance ( path & p_, node_id n_ ) noexcept {
+        for ( std::size_t h = m_height - 1u; h; --h ) {
+            bool const leaf = hdr ( n_ ).leaf;
+            if ( hdr ( n_ ).count >= ( leaf ? leaf_min : inner_min ) )
+                return;
+            auto [ parent, i ]     = p_[ h - 1u ];
+            bool const left        = i > 0u;
+            node_id const s        = children ( parent )[ left ? i - 1u : i + 1u ];
+            std::uint32_t const nc = hdr ( n_ ).count, sc = hdr ( s ).count;
+            if ( sc > ( leaf ? leaf_min : inner_min ) ) {
+                // Borrow one.
+                if ( leaf ) {
+                    if ( left ) {
+                        move_entries ( n_, 1u, n_, 0u, nc );
+                        move_entries ( n_, 0u, s, sc - 1u, 1u );
+                        keys ( parent )[ i - 1u ] = keys ( n_ )[ 0 ];
+                    }
+                    else {
+                        move_entries ( n_, nc, s, 0u, 1u );
+                        move_entries ( s, 0u, s, 1u, sc - 1u );
+                        keys ( parent )[ i ] = keys ( s )[ 0 ];
+                    }
+                }
+                else {
+                    if ( left ) {
+                        move_keys ( n_, 1u, n_, 0u, nc );
+                        move_children ( n_, 1u, n_, 0u, nc + 1u );
+                        keys ( n_ )[ 0 ]          = keys ( parent )[ i - 1u ];
+                        children ( n_ )[ 0 ]      = children ( s )[ sc ];
+                        keys ( parent )[ i - 1u ] = keys ( s )[ sc - 1u ];
+                    }
+                    else {
+                        keys ( n_ )[ nc ]          = keys ( parent )[ i ];
+                        children ( n_ )[ nc + 1u ] = children ( s )[ 0 ];
+                        keys ( parent )[ i ]       = keys ( s )[ 0 ];
+                        move_keys ( s, 0u, s, 1u, sc - 1u );
+                        move_children ( s, 0u, s, 1u, sc );
+                    }
+                }
+                ++hdr ( n_ ).count;
+                --hdr ( s ).count;
+                return;
+            }
+            // Merge the right one of the pair into the left one, remove the separator from the parent.
+            node_id const l = left ? s : n_, r = left ? n_ : s;
+            std::uint32_t const k = left ? i - 1u : i, lc = hdr ( l ).count, rc = hdr ( r ).count;
+            if ( leaf ) {
+                move_entries ( l, lc, r, 0u, rc );
+                hdr ( l ).count = lc + rc;
+                hdr ( l ).next  = hdr ( r ).next;
+                if ( hdr ( r ).next != nil )
+                    hdr ( hdr ( r ).next ).prev = l;
+            }
+            else {
+                keys ( l )[ lc ] = keys ( parent )[ k ];
+                move_keys ( l, lc + 1u, r, 0u, rc );
+                move_children ( l, lc + 1u, r, 0u, rc + 1u );
+                hdr ( l ).count = lc + rc + 1u;
+            }
+            free_node ( r );
+            std::uint32_t const pc = hdr ( parent ).count;
+            move_keys ( parent, k, parent, k + 1u, pc - k - 1u );
+            move_children ( parent, k + 1u, parent, k + 2u, pc - k - 1u );
+            --hdr ( parent ).count;
+            n_ = parent;
+        }
+        // The root, an inner root without keys is replaced by its only child.
+        if ( not hdr ( m_root ).leaf and not hdr ( m_root ).count ) {
+            node_id const root = m_root;
+            m_root             = children ( root )[ 0 ];
+            free_node ( root );
+            --m_height;
+        }
+    }
+
+    template<typename KeyAt, typename ValueAt>
+    void bulk_load_impl ( std::size_t const n_, KeyAt key_at_, ValueAt value_at_, float const fill_ ) {
+        if ( HEDLEY_UNLIKELY ( m_size ) )
+            throw std::runtime_error ( "vm_btree_map: bulk_load requires an empty map" );
+        if ( HEDLEY_UNLIKELY ( n_ > static_cast<std::size_t> ( Capacity ) ) )
+            throw std::bad_alloc ( );
+        if ( not n_ )
+            return;
+        std::size_t const per_leaf =
+            std::clamp<std::size_t> ( static_cast<std::size_t> ( fill_ * leaf_capacity ), leaf_min, leaf_capacity );
+        // The leaves, entries spread evenly. At most n_ / leaf_min leaves, so no leaf is less than half full (a
+        // single leaf, the root, excepted), which overrides fill_ for a small n_.
+        std::vector<node_id> level;
+        std::vector<Key> low; // The lowest key in the subtree of each node in level.
+        std::size_t m = std::max<std::size_t> ( 1u, std::min ( ( n_ + per_leaf - 1u ) / per_leaf, n_ / leaf_min ) );
+        level.reserve ( m );
+        low.reserve ( m );
+        free_node ( m_root );
+        node_id prev = nil;
+        for ( std::size_t j = 0u, e = 0u; j < m; ++j ) {
+            node_id const l        = allocate_node ( true );
+            std::size_t const last = n_ * ( j + 1u ) / m;
+            std::uint32_t c        = 0u;
+            for ( ; e < last; ++e, ++c ) {
+                assert ( not e or m_compare ( key_at_ ( e - 1u ), key_at_ ( e ) ) );
+                keys ( l )[ c ]   = key_at_ ( e );
+                values ( l )[ c ] = value_at_ ( e );
+            }
+            hdr ( l ).count = c;
+            hdr ( l ).prev  = prev;
+            if ( prev != nil )
+                hdr ( prev ).next = l;
+            prev = l;
+            level.push_back ( l );
+            low.push_back ( keys ( l )[ 0 ] );
+        }
+        m_height = 1u;
+        // The inner levels, children spread evenly, likewise at least inner_min + 1 children per node.
+        while ( level.size ( ) > 1u ) {
+            std::size_t const cn = level.size ( ), full = ( cn + inner_capacity ) / ( inner_capacity + 1u );
+            m             = std::max<std::size_t> ( 1u, std::min ( full, cn / ( inner_min + 1u ) ) );
+            std::size_t w = 0u;
+            for ( std::size_t j = 0u, e = 0u; j < m; ++j ) {
+                node_id const p        = allocate_node ( false );
+                std::size_t const last = cn * ( j + 1u ) / m;
+                Key const lowest       = low[ e ];
+                children ( p )[ 0 ]    = level[ e++ ];
+                std::uint32_t c        = 0u;
+                for ( ; e < last; ++e, ++c ) {
+                    keys ( p )[ c ]          = low[ e ];
+                    children ( p )[ c + 1u ] = level[ e ];
+                }
+                hdr ( p ).count = c;
+                level[ w ]      = p;
+                low[ w++ ]      = lowest;
+            }
+            level.resize ( w );
+            low.resize ( w );
+            ++m_height;
+        }
+        m_root = level[ 0 ];
+        m_size = static_cast<size_type> ( n_ );
+    }
+
+    char * m_nodes;
+    std::vector<node_id> m_free;
+    node_id m_next       = 0u, m_root;
+    std::size_t m_height = 1u;
+    size_type m_size     = 0u;
+    Compare m_compare;
+};
+
+} // namespace sax
@@ -0,0 +1,318 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef NOMINMAX
+#    define NOMINMAX
+#endif
+
+#include <fileapi.h>
+#include <handleapi.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <initializer_list>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <hedley.hpp>
+
+#include "bit_ops.hpp"
+#include "vm_fault.hpp"
+#include "winsys.hpp"
+
+// Incremental checkpoints of a vm_vector or vm_array: a checkpoint writes only the pages written to since the
+// previous one, as a delta file, a base (a full checkpoint) plus its deltas restore the container.
+//
+// Writes are tracked with write-protect faults: a checkpoint protects the pages it wrote PAGE_READONLY, the
+// first write to a page after that faults (once per page), marks it dirty and makes it writable again. Windows
+// has no soft-dirty bits, and its write watch (GetWriteWatch) only works for allocations reserved with
+// MEM_WRITE_WATCH, the fault costs some microseconds per page per checkpoint interval instead. Reads, and
+// appends to fresh pages, never fault. The checkpoint i/o is proportional to the pages written.
+//
+// The container must outlive the checkpointer and must not be moved while tracked. Writers can keep running
+// during a checkpoint, but then a page can be written half updated, to be written again by the next one: quiet
+// the writers for a consistent snapshot.
+
+namespace sax {
+
+namespace detail {
+
+struct checkpoint_header {
+    std::uint32_t magic    = 0x4B43'5853u; // "SXCK"
+    std::uint32_t version  = 1u;
+    std::uint64_t sequence = 0u;
+    std::uint64_t size_b   = 0u; // The size of the container.
+    std::uint64_t runs     = 0u;
+    std::uint32_t full     = 0u;
+    std::uint32_t reserved = 0u;
+};
+
+// A run of pages, followed by its length_b bytes.
+struct checkpoint_run {
+    std::uint64_t offset_b = 0u, length_b = 0u;
+};
+
+inline void write_all ( HANDLE const file_, void const * const p_, std::uint64_t n_ ) {
+    char const * p = static_cast<char const *> ( p_ );
+    while ( n_ ) {
+        DWORD const len = static_cast<DWORD> ( std::min<std::uint64_t> ( n_, 1'073'741'824u ) );
+        DWORD done      = 0u;
+        if ( HEDLEY_UNLIKELY ( not WriteFile ( file_, p, len, std::addressof ( done ), nullptr ) or done != len ) )
+            throw std::runtime_error ( "WriteFile error: " + sax::win::last_error ( ) );
+        p += len;
+        n_ -= len;
+    }
+}
+
+inline void read_all ( HANDLE const file_, void * const p_, std::uint64_t n_ ) {
+    char * p = static_cast<char *> ( p_ );
+    while ( n_ ) {
+        DWORD const len = static_cast<DWORD> ( std::min<std::uint64_t> ( n_, 1'073'741'824u ) );
+        DWORD done      = 0u;
+        if ( HEDLEY_UNLIKELY ( not ReadFile ( file_, p, len, std::addressof ( done ), nullptr ) ) )
+            throw std::runtime_error ( "ReadFile error: " + sax::win::last_error ( ) );
+        if ( HEDLEY_UNLIKELY ( done != len ) )
+            throw std::runtime_error ( "vm_checkpoint: truncated file" );
+        p += len;
+        n_ -= len;
+    }
+}
+
+// Whether Container has append_uninitialized ( ) (a vm_vector), else it has a fixed size (a vm_array).
+template<typename Container, typename = void>
+struct appends_uninitialized : std::false_type {};
+template<typename Container>
+struct appends_uninitialized<
+    Container, std::void_t<decltype ( std::declval<Container &> ( ).append_uninitialized ( typename Container::size_type{ } ) )>>
+    : std::true_type {};
+
+} // namespace detail
+
+template<typename Container>
+struct vm_checkpoint {
+
+    using container_type = Container;
+    using value_type     = typename Container::value_type;
+    using size_type      = typename Container::size_type;
+
+    static_assert ( std::is_trivially_copyable<value_type>::value, "vm_checkpoint requires a trivially copyable type" );
+
+    static constexpr std::size_t page_b = 4'096u; // The page size of x86/x64 Windows.
+
+    // Tracks the writes to c_, the first checkpoint is a full one.
+    explicit vm_checkpoint ( container_type & c_ ) :
+        m_container{ c_ }, m_data{ reinterpret_cast<char *> ( c_.data ( ) ) }, m_dirty{
+            std::make_unique<std::atomic<std::uint64_t>[]> ( ( reserved_b ( ) / page_b + 63u ) / 64u )
+        } {
+        fault_registry::add ( m_data, reserved_b ( ), on_fault, this );
+    }
+
+    vm_checkpoint ( vm_checkpoint const & )             = delete;
+    vm_checkpoint & operator= ( vm_checkpoint const & ) = delete;
+
+    ~vm_checkpoint ( ) noexcept {
+        fault_registry::remove ( m_data );
+        DWORD old;
+        if ( m_armed )
+            VirtualProtect ( m_data, m_armed * page_b, PAGE_READWRITE, std::addressof ( old ) );
+    }
+
+    // The sequence number of the last checkpoint written, 0 if none.
+    [[nodiscard]] std::uint64_t sequence ( ) const noexcept { return m_sequence; }
+
+    // The number of pages written to since the last checkpoint, pages appended since not counted.
+    [[nodiscard]] std::size_t dirty_pages ( ) const noexcept {
+        std::scoped_lock lock{ m_mutex };
+        std::size_t n = 0u;
+        for ( std::size_t w = 0u, e = ( m_armed + 63u ) / 64u; w < e; ++w )
+            n += static_cast<std::size_t> ( sax::popcount ( m_dirty[ w ].load ( std::memory_order_relaxed ) ) );
+        return n;
+    }
+
+    // Writes the pages written to since the last checkpoint (all pages if full_, or if it is the first) to the
+    // file at path_, replacing it, returns the number of bytes of the container written.
+    [[maybe_unused]] std::uint64_t checkpoint ( wchar_t const * const path_, bool full_ = false ) {
+        full_ = full_ or not m_sequence;
+        std::vector<detail::checkpoint_run> runs;
+        std::uint64_t const size_b = static_cast<std::uint64_t> ( m_container.size ( ) ) * sizeof ( value_type );
+        std::size_t const pages    = static_cast<std::size_t> ( ( size_b + page_b - 1u ) / page_b );
+        {
+            // Collect and protect the dirty pages under the lock, a write faulting meanwhile is not lost.
+            std::scoped_lock lock{ m_mutex };
+            auto const dirty = [ this, full_ ] ( std::size_t const p_ ) noexcept { return take ( p_ ) or full_ or p_ >= m_armed; };
+            for ( std::size_t p = 0u; p < pages; ) {
+                if ( not dirty ( p ) ) {
+                    ++p;
+                    continue;
+                }
+                std::size_t const first = p;
+                while ( ++p < pages and dirty ( p ) )
+                    ;
+                runs.push_back ( { first * page_b, std::min<std::uint64_t> ( p * page_b, size_b ) - first * page_b } );
+                DWORD old;
+                if ( HEDLEY_UNLIKELY ( not VirtualProtect ( m_data + first * page_b, ( p - first ) * page_b, PAGE_READONLY,
+                                                            std::addressof ( old ) ) ) )
+                    throw std::runtime_error ( "VirtualProtect error: " + sax::win::last_error ( ) );
+            }
+            m_armed = std::max ( m_armed, pages );
+        }
+        try {
+            sax::win::unique_handle file{ CreateFile ( path_, GENERIC_WRITE, 0u, nullptr, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN,
+                                                       nullptr ) };
+            if ( HEDLEY_UNLIKELY ( not file ) )
+                throw std::runtime_error ( "CreateFile error: " + sax::win::last_error ( ) );
+            detail::checkpoint_header h;
+            h.sequence = m_sequence + 1u;
+            h.size_b   = size_b;
+            h.runs     = runs.size ( );
+            h.full     = full_;
+            detail::write_all ( file.get ( ), std::addressof ( h ), sizeof ( h ) );
+            std::uint64_t written = 0u;
+            for ( detail::checkpoint_run const & r : runs ) {
+                detail::write_all ( file.get ( ), std::addressof ( r ), sizeof ( r ) );
+                detail::write_all ( file.get ( ), m_data + r.offset_b, r.length_b );
+                written += r.length_b;
+            }
+            ++m_sequence;
+            return written;
+        }
+        catch ( ... ) {
+            // The pages go into the next checkpoint.
+            for ( detail::checkpoint_run const & r : runs )
+                for ( std::uint64_t o = r.offset_b; o < r.offset_b + r.length_b; o += page_b )
+                    mark ( static_cast<std::size_t> ( o / page_b ) );
+            throw;
+        }
+    }
+
+    // Continues the chain of the checkpoint sequence_ from the current contents, f.e. restored from it, the
+    // next checkpoint is a delta on top of it.
+    void resume ( std::uint64_t const sequence_ ) {
+        std::scoped_lock lock{ m_mutex };
+        std::size_t const pages = static_cast<std::size_t> (
+            ( static_cast<std::uint64_t> ( m_container.size ( ) ) * sizeof ( value_type ) + page_b - 1u ) / page_b );
+        for ( std::size_t w = 0u, e = ( m_armed + 63u ) / 64u; w < e; ++w )
+            m_dirty[ w ].store ( 0u, std::memory_order_relaxed );
+        DWORD old;
+        if ( pages and HEDLEY_UNLIKELY ( not VirtualProtect ( m_data, pages * page_b, PAGE_READONLY, std::addressof ( old ) ) ) )
+            throw std::runtime_error ( "VirtualProtect error: " + sax::win::last_error ( ) );
+        m_armed    = std::max ( m_armed, pages );
+        m_sequence = sequence_;
+    }
+
+    // Restores c_ from a full checkpoint followed by the deltas on top of it, the n_ files at paths_, in order,
+    // returns the sequence number of the last one.
+    [[maybe_unused]] static std::uint64_t restore ( container_type & c_, wchar_t const * const * const paths_,
+                                                    std::size_t const n_ ) {
+        std::uint64_t sequence = 0u;
+        for ( std::size_t i = 0u; i < n_; ++i ) {
+            wchar_t const * const path = paths_[ i ];
+            sax::win::unique_handle file{ CreateFile ( path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                                       FILE_FLAG_SEQUENTIAL_SCAN, nullptr ) };
+            if ( HEDLEY_UNLIKELY ( not file ) )
+                throw std::runtime_error ( "CreateFile error: " + sax::win::last_error ( ) );
+            detail::checkpoint_header h;
+            detail::checkpoint_header const expected;
+            detail::read_all ( file.get ( ), std::addressof ( h ), sizeof ( h ) );
+            if ( HEDLEY_UNLIKELY ( h.magic != expected.magic or h.version != expected.version ) )
+                throw std::runtime_error ( "vm_checkpoint: not a checkpoint file" );
+            if ( HEDLEY_UNLIKELY ( sequence ? h.sequence != sequence + 1u : not h.full ) )
+                throw std::runtime_error ( "vm_checkpoint: checkpoint out of sequence" );
+            if ( HEDLEY_UNLIKELY ( h.size_b % sizeof ( value_type ) or h.size_b / sizeof ( value_type ) > c_.capacity ( ) ) )
+                throw std::runtime_error ( "vm_checkpoint: size mismatch" );
+            resize ( c_, static_cast<size_type> ( h.size_b / sizeof ( value_type ) ) );
+            char * const data = reinterpret_cast<char *> ( c_.data ( ) );
+            for ( std::uint64_t i = 0u; i < h.runs; ++i ) {
+                detail::checkpoint_run r;
+                detail::read_all ( file.get ( ), std::addressof ( r ), sizeof ( r ) );
+                if ( HEDLEY_UNLIKELY ( r.offset_b > h.size_b or r.length_b > h.size_b - r.offset_b ) )
+                    throw std::runtime_error ( "vm_checkpoint: corrupt file" );
+                detail::read_all ( file.get ( ), data + r.offset_b, r.length_b );
+            }
+            sequence = h.sequence;
+        }
+        return sequence;
+    }
+    [[maybe_unused]] static std::uint64_t restore ( container_type & c_, std::initializer_list<wchar_t const *> const paths_ ) {
+        return restore ( c_, paths_.begin ( ), paths_.size ( ) );
+    }
+
+    private:
+    [[nodiscard]] std::size_t reserved_b ( ) const noexcept {
+        return ( static_cast<std::size_t> ( m_container.capacity ( ) ) * sizeof ( value_type ) + page_b - 1u ) / page_b * page_b;
+    }
+
+    // Sizes c_ to n_ elements, a vm_array must be that size.
+    static void resize ( container_type & c_, size_type const n_ ) {
+        if constexpr ( detail::appends_uninitialized<container_type>::value ) {
+            if ( n_ > c_.size ( ) )
+                c_.append_uninitialized ( n_ - c_.size ( ) );
+            else
+                c_.erase ( c_.begin ( ) + n_, c_.end ( ) );
+        }
+        else {
+            if ( HEDLEY_UNLIKELY ( n_ != c_.size ( ) ) )
+                throw std::runtime_error ( "vm_checkpoint: size mismatch" );
+        }
+    }
+
+    void mark ( std::size_t const p_ ) noexcept {
+        m_dirty[ p_ / 64u ].fetch_or ( std::uint64_t{ 1 } << ( p_ % 64u ), std::memory_order_relaxed );
+    }
+    // Clears the dirty bit of page p_, returns whether it was set.
+    [[nodiscard]] bool take ( std::size_t const p_ ) noexcept {
+        std::uint64_t const bit = std::uint64_t{ 1 } << ( p_ % 64u );
+        return m_dirty[ p_ / 64u ].fetch_and ( ~bit, std::memory_order_relaxed ) & bit;
+    }
+
+    static bool on_fault ( void * const context_, void * const address_, bool const write_ ) noexcept {
+        vm_checkpoint & c   = *static_cast<vm_checkpoint *> ( context_ );
+        std::size_t const p = static_cast<std::size_t> ( static_cast<char *> ( address_ ) - c.m_data ) / page_b;
+        std::scoped_lock lock{ c.m_mutex };
+        if ( not write_ or p >= c.m_armed )
+            return false; // Not ours, a plain access violation.
+        c.mark ( p );
+        DWORD old;
+        return VirtualProtect ( c.m_data + p * page_b, page_b, PAGE_READWRITE, std::addressof ( old ) );
+    }
+
+    container_type & m_container;
+    char * m_data;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> m_dirty; // A bit per page.
+    std::size_t m_armed      = 0u;                         // Pages [ 0, m_armed ) are tracked.
+    std::uint64_t m_sequence = 0u;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace sax
@@ -0,0 +1,323 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef NOMINMAX
+#    define NOMINMAX
+#endif
+
+#include <Memoryapi.h>
+#include <handleapi.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <hedley.hpp>
+
+#include "lz_codec.hpp"
+#include "vm_fault.hpp"
+#include "winsys.hpp"
+
+// An append-only vector that compresses the segments that have not been accessed for a while into a side
+// store and decommits their pages. Touching a compressed segment decompresses it back into place.
+//
+// Accesses are detected with an emulated access bit: age ( ) protects the segments accessed since the last
+// call PAGE_NOACCESS, the first access after that faults (once per segment) and makes the segment accessible
+// again. A segment that stays untouched for window_ calls of age ( ) is compressed, the pages of a compressed
+// segment are unmapped, the access faults as well and the segment is decompressed in the faulting thread.
+// Readers (and writers of existing elements) use plain pointers.
+//
+// The reservation is a placeholder, a segment a (pagefile backed) section mapped into its slot. Unmapping it
+// frees its pages, a cold segment is decompressed into a fresh section through a private view and then mapped
+// into its slot, so other threads see it whole or fault and wait.
+//
+// Only the whole segments below size ( ) age, appending (by one thread) never faults.
+
+namespace sax {
+
+template<typename ValueType, typename SizeType, SizeType Capacity, std::size_t SegmentB = 262'144u>
+struct vm_cold_vector {
+
+    static_assert ( std::is_trivially_copyable<ValueType>::value, "vm_cold_vector requires a trivially copyable type" );
+    static_assert ( not( SegmentB % 65'536u ), "the segment size must be a multiple of 64KB" );
+
+    using value_type = ValueType;
+
+    using pointer       = value_type *;
+    using const_pointer = value_type const *;
+
+    using reference       = value_type &;
+    using const_reference = value_type const &;
+
+    using size_type       = SizeType;
+    using difference_type = std::make_signed_t<size_type>;
+
+    using iterator       = pointer;
+    using const_iterator = const_pointer;
+
+    static constexpr std::size_t segment_b = SegmentB;
+
+    // A segment is compressed after window_ calls of age ( ) without an access.
+    explicit vm_cold_vector ( std::uint32_t const window_ = 2u ) :
+        m_data{ static_cast<char *> ( sax::win::reserve_placeholder ( reserved_b ) ) },
+        m_segments ( reserved_b / segment_b ), m_window{ std::max ( window_, 1u ) } {
+        if ( HEDLEY_UNLIKELY ( not m_data ) )
+            throw std::bad_alloc ( );
+        try {
+            fault_registry::add ( m_data, reserved_b, on_fault, this );
+        }
+        catch ( ... ) {
+            sax::win::release_placeholders ( m_data, reserved_b );
+            throw;
+        }
+    }
+
+    vm_cold_vector ( vm_cold_vector const & )             = delete;
+    vm_cold_vector & operator= ( vm_cold_vector const & ) = delete;
+
+    ~vm_cold_vector ( ) noexcept {
+        if ( HEDLEY_LIKELY ( m_data ) ) {
+            fault_registry::remove ( m_data );
+            std::size_t const mapped = m_committed_b.load ( std::memory_order_relaxed ) / segment_b;
+            for ( std::size_t s = 0u; s < mapped; ++s )
+                if ( m_segments[ s ].current != state::cold )
+                    sax::win::unmap_placeholder ( m_data + s * segment_b );
+            sax::win::release_placeholders ( m_data, reserved_b );
+            m_data = nullptr;
+        }
+    }
+
+    // Size.
+
+    [[nodiscard]] static constexpr size_type capacity ( ) noexcept { return Capacity; }
+    [[nodiscard]] static constexpr size_type max_size ( ) noexcept { return Capacity; }
+    [[nodiscard]] size_type size ( ) const noexcept { return m_size.load ( std::memory_order_acquire ); }
+    [[nodiscard]] bool empty ( ) const noexcept { return not size ( ); }
+
+    // The number of compressed segments and their size in the side store.
+    [[nodiscard]] std::size_t cold_segments ( ) const noexcept {
+        std::scoped_lock lock{ m_mutex };
+        return m_cold;
+    }
+    [[nodiscard]] std::size_t compressed_b ( ) const noexcept {
+        std::scoped_lock lock{ m_mutex };
+        return m_compressed_b;
+    }
+
+    // Access.
+
+    [[nodiscard]] const_pointer data ( ) const noexcept { return reinterpret_cast<const_pointer> ( m_data ); }
+    [[nodiscard]] pointer data ( ) noexcept { return reinterpret_cast<pointer> ( m_data ); }
+
+    [[nodiscard]] const_iterator begin ( ) const noexcept { return data ( ); }
+    [[nodiscard]] const_iterator cbegin ( ) const noexcept { return begin ( ); }
+    [[nodiscard]] iterator begin ( ) noexcept { return data ( ); }
+
+    [[nodiscard]] const_iterator end ( ) const noexcept { return data ( ) + size ( ); }
+    [[nodiscard]] const_iterator cend ( ) const noexcept { return end ( ); }
+    [[nodiscard]] iterator end ( ) noexcept { return data ( ) + size ( ); }
+
+    [[nodiscard]] const_reference operator[] ( size_type const i_ ) const noexcept {
+        assert ( i_ < size ( ) );
+        return data ( )[ i_ ];
+    }
+    [[nodiscard]] reference operator[] ( size_type const i_ ) noexcept {
+        return const_cast<reference> ( std::as_const ( *this )[ i_ ] );
+    }
+
+    [[nodiscard]] const_reference at ( size_type const i_ ) const {
+        if ( HEDLEY_LIKELY ( i_ < size ( ) ) )
+            return data ( )[ i_ ];
+        else
+            throw std::runtime_error ( "index out of bounds" );
+    }
+    [[nodiscard]] reference at ( size_type const i_ ) { return const_cast<reference> ( std::as_const ( *this ).at ( i_ ) ); }
+
+    // Modify.
+
+    template<typename... Args>
+    [[maybe_unused]] reference emplace_back ( Args &&... args_ ) {
+        size_type const n = m_size.load ( std::memory_order_relaxed );
+        if ( HEDLEY_UNLIKELY ( n == capacity ( ) ) )
+            throw std::bad_alloc ( );
+        commit_to ( ( n + 1u ) * sizeof ( value_type ) );
+        pointer const p = new ( data ( ) + n ) value_type{ std::forward<Args> ( args_ )... };
+        m_size.store ( n + 1u, std::memory_order_release );
+        return *p;
+    }
+    [[maybe_unused]] reference push_back ( const_reference v_ ) { return emplace_back ( v_ ); }
+
+    // Copies [ p_, p_ + n_ ) to the end.
+    void append ( const_pointer const p_, size_type const n_ ) {
+        size_type const n = m_size.load ( std::memory_order_relaxed );
+        if ( HEDLEY_UNLIKELY ( n_ > capacity ( ) - n ) )
+            throw std::bad_alloc ( );
+        commit_to ( ( n + n_ ) * sizeof ( value_type ) );
+        std::memcpy ( data ( ) + n, p_, n_ * sizeof ( value_type ) );
+        m_size.store ( n + n_, std::memory_order_release );
+    }
+
+    // Ages the segments by one epoch and compresses those not accessed for the window, returns the number
+    // compressed. Meant to be called periodically, f.e. from a timer thread.
+    [[maybe_unused]] std::size_t age ( ) {
+        std::scoped_lock lock{ m_mutex };
+        ++m_epoch;
+        std::size_t const sealed = size ( ) * sizeof ( value_type ) / segment_b;
+        std::size_t compressed   = 0u;
+        for ( std::size_t s = 0u; s < sealed; ++s ) {
+            segment & g    = m_segments[ s ];
+            char * const p = m_data + s * segment_b;
+            DWORD old;
+            if ( g.current == state::hot ) {
+                if ( HEDLEY_UNLIKELY ( not VirtualProtect ( p, segment_b, PAGE_NOACCESS, std::addressof ( old ) ) ) )
+                    throw std::runtime_error ( "VirtualProtect error: " + sax::win::last_error ( ) );
+                g.current  = state::armed;
+                g.armed_at = m_epoch;
+            }
+            else if ( g.current == state::armed and m_epoch - g.armed_at >= m_window ) {
+                if ( m_buffer.empty ( ) )
+                    m_buffer.resize ( lz::bound ( segment_b ) );
+                VirtualProtect ( p, segment_b, PAGE_READONLY, std::addressof ( old ) ); // Writers fault and wait.
+                std::size_t const n = lz::compress ( p, segment_b, m_buffer.data ( ) );
+                if ( n <= segment_b - segment_b / 8u ) {
+                    g.packed.assign ( m_buffer.data ( ), m_buffer.data ( ) + n );
+                    sax::win::unmap_placeholder ( p ); // The last view of the section, its pages go.
+                    g.current = state::cold;
+                    m_compressed_b += n;
+                    ++m_cold;
+                    ++compressed;
+                }
+                else { // Incompressible, left alone for another window.
+                    VirtualProtect ( p, segment_b, PAGE_NOACCESS, std::addressof ( old ) );
+                    g.armed_at = m_epoch;
+                }
+            }
+        }
+        return compressed;
+    }
+
+    // Decompresses all segments and makes them accessible, f.e. ahead of a scan.
+    void thaw ( ) {
+        std::scoped_lock lock{ m_mutex };
+        for ( std::size_t s = 0u; s < m_segments.size ( ); ++s ) {
+            if ( m_segments[ s ].current != state::hot and HEDLEY_UNLIKELY ( not warm ( s ) ) )
+                throw std::runtime_error ( "vm_cold_vector: thawing segment " + std::to_string ( s ) + " failed" );
+        }
+    }
+
+    private:
+    enum class state : std::uint8_t { hot, armed, cold };
+
+    struct segment {
+        state current          = state::hot;
+        std::uint32_t armed_at = 0u;
+        std::vector<unsigned char> packed;
+    };
+
+    static constexpr std::size_t reserved_b = ( Capacity * sizeof ( value_type ) + segment_b - 1u ) / segment_b * segment_b;
+
+    // Maps fresh segments until size_b_ bytes are mapped.
+    void commit_to ( std::size_t const size_b_ ) {
+        for ( std::size_t c = m_committed_b.load ( std::memory_order_relaxed ); c < size_b_; c += segment_b ) {
+            sax::win::unique_handle section{ create_section ( ) };
+            if ( HEDLEY_UNLIKELY ( not section ) )
+                throw std::bad_alloc ( );
+            sax::win::split_placeholder ( m_data + c, segment_b ); // Fails if it is a segment already.
+            if ( HEDLEY_UNLIKELY ( not sax::win::map_placeholder ( section.get ( ), m_data + c, segment_b ) ) )
+                throw std::bad_alloc ( );
+            m_committed_b.store ( c + segment_b, std::memory_order_release ); // The view keeps the section alive.
+        }
+    }
+
+    [[nodiscard]] static HANDLE create_section ( ) noexcept {
+        DWORD const high = static_cast<DWORD> ( std::uint64_t{ segment_b } >> 32 ), low = static_cast<DWORD> ( segment_b );
+        return CreateFileMapping ( INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, high, low, nullptr );
+    }
+
+    // Makes segment s_ accessible, decompressing it if it is cold, m_mutex held.
+    [[nodiscard]] bool warm ( std::size_t const s_ ) noexcept {
+        segment & g    = m_segments[ s_ ];
+        char * const p = m_data + s_ * segment_b;
+        DWORD old;
+        switch ( g.current ) {
+            case state::hot: return true; // Warmed by another thread meanwhile.
+            case state::armed:
+                if ( HEDLEY_UNLIKELY ( not VirtualProtect ( p, segment_b, PAGE_READWRITE, std::addressof ( old ) ) ) )
+                    return false;
+                break;
+            case state::cold: {
+                // Not in place, a reader would see the segment half filled.
+                sax::win::unique_handle section{ create_section ( ) };
+                if ( HEDLEY_UNLIKELY ( not section ) )
+                    return false;
+                void * const staging = MapViewOfFile ( section.get ( ), FILE_MAP_WRITE, 0u, 0u, segment_b );
+                if ( HEDLEY_UNLIKELY ( not staging ) )
+                    return false;
+                bool const whole = lz::decompress ( g.packed.data ( ), g.packed.size ( ), staging, segment_b ) == segment_b;
+                UnmapViewOfFile ( staging );
+                if ( HEDLEY_UNLIKELY ( not whole or not sax::win::map_placeholder ( section.get ( ), p, segment_b ) ) )
+                    return false;
+                m_compressed_b -= g.packed.size ( );
+                --m_cold;
+                std::vector<unsigned char> ( ).swap ( g.packed );
+            } break;
+        }
+        g.current = state::hot;
+        return true;
+    }
+
+    static bool on_fault ( void * const context_, void * const address_, bool ) noexcept {
+        vm_cold_vector & v  = *static_cast<vm_cold_vector *> ( context_ );
+        std::size_t const o = static_cast<std::size_t> ( static_cast<char *> ( address_ ) - v.m_data );
+        if ( o >= v.m_committed_b.load ( std::memory_order_acquire ) )
+            return false; // Not ours, a plain access violation.
+        std::scoped_lock lock{ v.m_mutex };
+        return v.warm ( o / segment_b );
+    }
+
+    char * m_data;
+    std::vector<segment> m_segments;
+    std::vector<unsigned char> m_buffer; // Compression scratch.
+    std::atomic<size_type> m_size{ 0u };
+    std::atomic<std::size_t> m_committed_b{ 0u };
+    std::size_t m_cold = 0u, m_compressed_b = 0u;
+    std::uint32_t m_epoch = 0u, m_window;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace sax
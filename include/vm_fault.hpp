@@ -0,0 +1,138 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef NOMINMAX
+#    define NOMINMAX
+#endif
+
+#include <errhandlingapi.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <hedley.hpp>
+
+#include "winsys.hpp"
+
+namespace sax {
+
+// Resolves an access violation at address_ (a write if write_) in the range it was registered for, returns
+// true if the access can be retried. Runs in the faulting thread, inside a vectored exception handler, so it
+// must not throw and must not register or remove ranges. It runs without the registry locked, a callback may
+// fault on another registered range (which nests), but it must not fault on the range it is resolving, that
+// would wait on itself.
+using fault_callback = bool ( * ) ( void * context_, void * address_, bool write_ ) noexcept;
+
+// Routes access violations in registered address ranges to their callback, the (Windows) equivalent of a
+// userfaultfd registration. A vectored exception handler is installed while there are ranges registered,
+// faults outside them are passed on untouched.
+struct fault_registry {
+
+    // Registers [ begin_, begin_ + size_b_ ), which must not overlap a registered range.
+    static void add ( void * const begin_, std::size_t const size_b_, fault_callback const f_, void * const context_ ) {
+        state & s = instance ( );
+        std::unique_lock lock{ s.mutex };
+        if ( not s.handler ) {
+            s.handler = AddVectoredExceptionHandler ( 1u, handler );
+            if ( HEDLEY_UNLIKELY ( not s.handler ) )
+                throw std::runtime_error ( "AddVectoredExceptionHandler error: " + sax::win::last_error ( ) );
+        }
+        s.entries.push_back ( { static_cast<char *> ( begin_ ), static_cast<char *> ( begin_ ) + size_b_, f_, context_ } );
+    }
+
+    // Removes the range starting at begin_, waits for callbacks in flight on any range to return. Once it
+    // returns, the callback of the range is not called anymore and its context can go.
+    static void remove ( void * const begin_ ) noexcept {
+        state & s = instance ( );
+        {
+            std::unique_lock lock{ s.mutex };
+            s.entries.erase ( std::remove_if ( s.entries.begin ( ), s.entries.end ( ),
+                                               [ begin_ ] ( entry const & e_ ) noexcept { return e_.begin == begin_; } ),
+                              s.entries.end ( ) );
+            if ( s.entries.empty ( ) and s.handler ) {
+                RemoveVectoredExceptionHandler ( s.handler );
+                s.handler = nullptr;
+            }
+        }
+        // A callback counts itself in under the lock, so any callback on the range removed is counted by now.
+        while ( s.in_flight.load ( std::memory_order_acquire ) )
+            std::this_thread::yield ( );
+    }
+
+    private:
+    struct entry {
+        char *begin, *end;
+        fault_callback callback;
+        void * context;
+    };
+
+    struct state {
+        std::shared_mutex mutex;
+        std::vector<entry> entries;
+        void * handler = nullptr;
+        std::atomic<std::size_t> in_flight{ 0u }; // Callbacks running.
+    };
+
+    [[nodiscard]] static state & instance ( ) noexcept {
+        static state s;
+        return s;
+    }
+
+    static LONG CALLBACK handler ( EXCEPTION_POINTERS * const e_ ) noexcept {
+        EXCEPTION_RECORD const & r = *e_->ExceptionRecord;
+        if ( r.ExceptionCode != EXCEPTION_ACCESS_VIOLATION or r.NumberParameters < 2u )
+            return EXCEPTION_CONTINUE_SEARCH;
+        char * const address = reinterpret_cast<char *> ( r.ExceptionInformation[ 1 ] );
+        state & s            = instance ( );
+        // Copy the entry out and run the callback unlocked, so remove ( ) (and add ( )) don't wait on a fill
+        // and a callback can fault on another range. The in flight count keeps the context alive meanwhile.
+        entry e{ };
+        {
+            std::shared_lock lock{ s.mutex };
+            auto const it = std::find_if ( s.entries.begin ( ), s.entries.end ( ), [ address ] ( entry const & e_ ) noexcept {
+                return e_.begin <= address and address < e_.end;
+            } );
+            if ( it == s.entries.end ( ) )
+                return EXCEPTION_CONTINUE_SEARCH;
+            e = *it;
+            s.in_flight.fetch_add ( 1u, std::memory_order_relaxed );
+        }
+        bool const resolved = e.callback ( e.context, address, r.ExceptionInformation[ 0 ] == 1u );
+        s.in_flight.fetch_sub ( 1u, std::memory_order_release );
+        return resolved ? EXCEPTION_CONTINUE_EXECUTION : EXCEPTION_CONTINUE_SEARCH;
+    }
+};
+
+} // namespace sax
@@ -0,0 +1,204 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef NOMINMAX
+#    define NOMINMAX
+#endif
+
+#include <fileapi.h>
+#include <handleapi.h>
+#include <ioapiset.h>
+#include <synchapi.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+#include <hedley.hpp>
+
+#include "vm_backed.hpp"
+#include "winsys.hpp"
+
+// Streams a vm_vector from and to a file with several overlapped (asynchronous) requests in flight. Reads
+// go straight into the committed pages past the end of the vector, writes come straight from its pages, so
+// no byte is copied in user space. Unbuffered (FILE_FLAG_NO_BUFFERING) i/o is used when the position in the
+// vector allows it, bypassing the file cache as well.
+
+namespace sax {
+
+struct io_options {
+    std::size_t block_b     = 1'048'576u; // Per request, a multiple of sector_b.
+    std::size_t queue_depth = 4u;         // Requests in flight, at most max_queue_depth.
+    bool unbuffered         = true;       // Bypass the file cache if alignment allows.
+
+    static constexpr std::size_t max_queue_depth = 16u;
+    // Unbuffered i/o requires buffer address, file offset and length to be multiples of the sector size,
+    // 4KB covers both 512e and 4Kn drives.
+    static constexpr std::size_t sector_b = 4'096u;
+};
+
+namespace detail {
+
+[[nodiscard]] constexpr std::size_t round_up_sector ( std::size_t const b_ ) noexcept {
+    return ( b_ + io_options::sector_b - 1u ) & ~( io_options::sector_b - 1u );
+}
+
+// Transfers length_b_ bytes between buf_ and the file, starting at file offset 0, with up to queue_depth
+// overlapped requests outstanding. For unbuffered handles requests are rounded up to whole sectors, buf_
+// must be valid (committed) up to the rounded length. Returns the number of bytes transferred.
+template<bool Write>
+[[nodiscard]] std::uint64_t overlapped_transfer ( HANDLE file_, char * buf_, std::uint64_t const length_b_, bool const unbuffered_,
+                                                  io_options const & o_ ) {
+    std::size_t const block = std::max ( o_.block_b & ~( io_options::sector_b - 1u ), io_options::sector_b );
+    std::size_t const depth = std::clamp ( o_.queue_depth, std::size_t{ 1u }, io_options::max_queue_depth );
+
+    struct request {
+        OVERLAPPED ov;
+        sax::win::unique_handle event;
+        bool pending;
+    };
+    std::array<request, io_options::max_queue_depth> q{ };
+    for ( std::size_t i = 0u; i < depth; ++i ) {
+        q[ i ].event.reset ( CreateEvent ( nullptr, TRUE, FALSE, nullptr ) );
+        if ( HEDLEY_UNLIKELY ( not q[ i ].event ) )
+            throw std::runtime_error ( "CreateEvent error: " + sax::win::last_error ( ) );
+    }
+
+    std::uint64_t issued = 0u, done = 0u;
+    auto issue = [ & ] ( request & r_ ) {
+        std::size_t const n = static_cast<std::size_t> ( std::min<std::uint64_t> ( block, length_b_ - issued ) );
+        DWORD const len     = static_cast<DWORD> ( unbuffered_ ? round_up_sector ( n ) : n );
+        r_.ov               = OVERLAPPED{ };
+        r_.ov.Offset        = static_cast<DWORD> ( issued );
+        r_.ov.OffsetHigh    = static_cast<DWORD> ( issued >> 32 );
+        r_.ov.hEvent        = r_.event.get ( );
+        BOOL ok;
+        if constexpr ( Write )
+            ok = WriteFile ( file_, buf_ + issued, len, nullptr, std::addressof ( r_.ov ) );
+        else
+            ok = ReadFile ( file_, buf_ + issued, len, nullptr, std::addressof ( r_.ov ) );
+        if ( HEDLEY_UNLIKELY ( not ok and GetLastError ( ) != ERROR_IO_PENDING ) )
+            throw std::runtime_error ( ( Write ? "WriteFile error: " : "ReadFile error: " ) + sax::win::last_error ( ) );
+        r_.pending = true;
+        issued += n;
+    };
+    auto complete = [ & ] ( request & r_ ) {
+        DWORD got  = 0u;
+        r_.pending = false;
+        if ( HEDLEY_UNLIKELY ( not GetOverlappedResult ( file_, std::addressof ( r_.ov ), std::addressof ( got ), TRUE ) ) ) {
+            if ( GetLastError ( ) != ERROR_HANDLE_EOF )
+                throw std::runtime_error ( "GetOverlappedResult error: " + sax::win::last_error ( ) );
+            got = 0u;
+        }
+        done += got;
+    };
+
+    try {
+        // The ring is serviced in issue order, so completions add up to a contiguous prefix.
+        for ( std::size_t i = 0u; i < depth and issued < length_b_; ++i )
+            issue ( q[ i ] );
+        for ( std::size_t i = 0u; q[ i ].pending; i = ( i + 1u ) % depth ) {
+            complete ( q[ i ] );
+            if ( issued < length_b_ )
+                issue ( q[ i ] );
+        }
+    }
+    catch ( ... ) {
+        // The buffer must outlive the requests that refer to it.
+        for ( std::size_t i = 0u; i < depth; ++i ) {
+            DWORD got;
+            if ( q[ i ].pending )
+                GetOverlappedResult ( file_, std::addressof ( q[ i ].ov ), std::addressof ( got ), TRUE );
+        }
+        throw;
+    }
+    // Unbuffered transfers are rounded up to whole sectors.
+    return std::min ( done, length_b_ );
+}
+
+} // namespace detail
+
+// Appends the records in the file at path_ to v_, returns the number of records read. The size of the file
+// must be a multiple of sizeof ( ValueType ).
+template<typename ValueType, typename SizeType, SizeType Capacity, typename GrowthPolicy>
+[[maybe_unused]] SizeType ingest ( vm_vector<ValueType, SizeType, Capacity, GrowthPolicy> & v_, wchar_t const * const path_,
+                                   io_options const & o_ = { } ) {
+    static_assert ( std::is_trivially_copyable<ValueType>::value, "ingest requires a trivially copyable type" );
+    std::size_t const at_b = static_cast<std::size_t> ( v_.size ( ) ) * sizeof ( ValueType );
+    bool const unbuffered  = o_.unbuffered and not( at_b % io_options::sector_b );
+    DWORD const flags      = FILE_FLAG_OVERLAPPED | ( unbuffered ? FILE_FLAG_NO_BUFFERING : FILE_FLAG_SEQUENTIAL_SCAN );
+    sax::win::unique_handle file{ CreateFile ( path_, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr ) };
+    if ( HEDLEY_UNLIKELY ( not file ) )
+        throw std::runtime_error ( "CreateFile error: " + sax::win::last_error ( ) );
+    LARGE_INTEGER fs;
+    if ( HEDLEY_UNLIKELY ( not GetFileSizeEx ( file.get ( ), std::addressof ( fs ) ) ) )
+        throw std::runtime_error ( "GetFileSizeEx error: " + sax::win::last_error ( ) );
+    std::uint64_t const length_b = static_cast<std::uint64_t> ( fs.QuadPart );
+    if ( HEDLEY_UNLIKELY ( length_b % sizeof ( ValueType ) ) )
+        throw std::runtime_error ( "ingest: the file size is not a multiple of the record size" );
+    std::uint64_t const n = length_b / sizeof ( ValueType );
+    if ( HEDLEY_UNLIKELY ( n > static_cast<std::uint64_t> ( v_.capacity ( ) - v_.size ( ) ) ) )
+        throw std::bad_alloc ( );
+    // The commit is page granular, so it covers the last sector rounded up.
+    v_.reserve ( static_cast<SizeType> ( v_.size ( ) + n ) );
+    char * const buf = reinterpret_cast<char *> ( v_.data ( ) + v_.size ( ) );
+    if ( HEDLEY_UNLIKELY ( detail::overlapped_transfer<false> ( file.get ( ), buf, length_b, unbuffered, o_ ) != length_b ) )
+        throw std::runtime_error ( "ingest: short read" );
+    v_.append_uninitialized ( static_cast<SizeType> ( n ) );
+    return static_cast<SizeType> ( n );
+}
+
+// Writes the elements of v_ to the file at path_, replacing it.
+template<typename ValueType, typename SizeType, SizeType Capacity, typename GrowthPolicy>
+void dump ( vm_vector<ValueType, SizeType, Capacity, GrowthPolicy> const & v_, wchar_t const * const path_,
+            io_options const & o_ = { } ) {
+    static_assert ( std::is_trivially_copyable<ValueType>::value, "dump requires a trivially copyable type" );
+    DWORD const flags = FILE_FLAG_OVERLAPPED | ( o_.unbuffered ? FILE_FLAG_NO_BUFFERING : FILE_ATTRIBUTE_NORMAL );
+    sax::win::unique_handle file{ CreateFile ( path_, GENERIC_WRITE, 0u, nullptr, CREATE_ALWAYS, flags, nullptr ) };
+    if ( HEDLEY_UNLIKELY ( not file ) )
+        throw std::runtime_error ( "CreateFile error: " + sax::win::last_error ( ) );
+    std::uint64_t const length_b = static_cast<std::uint64_t> ( v_.size ( ) ) * sizeof ( ValueType );
+    // The data starts page aligned and the pages are committed in whole, the tail of the last sector is
+    // written as well and cut off again below.
+    char * const buf = const_cast<char *> ( reinterpret_cast<char const *> ( v_.data ( ) ) );
+    if ( HEDLEY_UNLIKELY ( detail::overlapped_transfer<true> ( file.get ( ), buf, length_b, o_.unbuffered, o_ ) != length_b ) )
+        throw std::runtime_error ( "dump: short write" );
+    if ( o_.unbuffered and length_b % io_options::sector_b ) {
+        FILE_END_OF_FILE_INFO eof;
+        eof.EndOfFile.QuadPart = static_cast<LONGLONG> ( length_b );
+        if ( HEDLEY_UNLIKELY ( not SetFileInformationByHandle ( file.get ( ), FileEndOfFileInfo, std::addressof ( eof ),
+                                                                sizeof ( FILE_END_OF_FILE_INFO ) ) ) )
+            throw std::runtime_error ( "SetFileInformationByHandle error: " + sax::win::last_error ( ) );
+    }
+}
+
+} // namespace sax
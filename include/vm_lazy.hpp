@@ -0,0 +1,279 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef NOMINMAX
+#    define NOMINMAX
+#endif
+
+#include <Memoryapi.h>
+#include <fileapi.h>
+#include <handleapi.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <hedley.hpp>
+
+#include "vm_fault.hpp"
+#include "winsys.hpp"
+
+// Lazily populated memory: the address range is reserved up front, a 64KB granule is filled by a user
+// supplied function (a decompressor, a file reader, a computation) the first time it is accessed. Readers
+// use plain pointers, there is no check on access.
+//
+// The range is a placeholder. The first access to a granule faults, the fault registry calls back into the
+// region, which fills a fresh section through a private view and then maps that section into the
+// placeholder. The granule appears filled and all at once (like UFFDIO_COPY), other threads touching it
+// meanwhile fault as well and wait for it. The fill runs in the faulting thread.
+
+namespace sax {
+
+// Writes the size_b_ bytes of the region from offset_b_ to dst_. If it throws, the access that caused the
+// fill is left an access violation. It runs with the region locked, so it must not touch unpopulated memory
+// of the region it fills (that faults and deadlocks), reading another lazy region is fine.
+using lazy_fill = std::function<void ( std::size_t offset_b_, void * dst_, std::size_t size_b_ )>;
+
+struct lazy_region {
+
+    static constexpr std::size_t granule_b = 65'536u; // The allocation granularity, placeholders are split in these.
+
+    lazy_region ( std::size_t const size_b_, lazy_fill fill_ ) :
+        m_size_b{ size_b_ }, m_reserved_b{ ( size_b_ + granule_b - 1u ) / granule_b * granule_b }, m_fill{ std::move ( fill_ ) },
+        m_populated ( m_reserved_b / granule_b, false ) {
+        m_data = static_cast<char *> ( sax::win::reserve_placeholder ( m_reserved_b ) );
+        if ( HEDLEY_UNLIKELY ( not m_data ) )
+            throw std::bad_alloc ( );
+        try {
+            fault_registry::add ( m_data, m_reserved_b, on_fault, this );
+        }
+        catch ( ... ) {
+            sax::win::release_placeholders ( m_data, m_reserved_b );
+            throw;
+        }
+    }
+
+    lazy_region ( lazy_region const & )             = delete;
+    lazy_region & operator= ( lazy_region const & ) = delete;
+
+    ~lazy_region ( ) {
+        if ( HEDLEY_LIKELY ( m_data ) ) {
+            fault_registry::remove ( m_data );
+            for ( std::size_t g = 0u; g < m_populated.size ( ); ++g )
+                if ( m_populated[ g ] )
+                    sax::win::unmap_placeholder ( m_data + g * granule_b );
+            sax::win::release_placeholders ( m_data, m_reserved_b );
+            m_data = nullptr;
+        }
+    }
+
+    [[nodiscard]] void * data ( ) const noexcept { return m_data; }
+    [[nodiscard]] std::size_t size_b ( ) const noexcept { return m_size_b; }
+
+    [[nodiscard]] bool populated ( std::size_t const offset_b_ ) const noexcept {
+        std::scoped_lock lock{ m_mutex };
+        return m_populated[ offset_b_ / granule_b ];
+    }
+    [[nodiscard]] std::size_t populated_b ( ) const noexcept {
+        std::scoped_lock lock{ m_mutex };
+        return m_populated_count * granule_b;
+    }
+
+    // Fills the granules spanning [ first_b_, last_b_ ) ahead of access.
+    void prefetch ( std::size_t const first_b_, std::size_t last_b_ ) {
+        last_b_ = std::min ( last_b_, m_size_b );
+        for ( std::size_t g = first_b_ / granule_b; g * granule_b < last_b_; ++g )
+            if ( HEDLEY_UNLIKELY ( not populate ( g ) ) )
+                throw std::runtime_error ( "lazy_region: populating a granule failed" );
+    }
+
+    private:
+    static bool on_fault ( void * const context_, void * const address_, [[maybe_unused]] bool const write_ ) noexcept {
+        lazy_region & r = *static_cast<lazy_region *> ( context_ );
+        return r.populate ( static_cast<std::size_t> ( static_cast<char *> ( address_ ) - r.m_data ) / granule_b );
+    }
+
+    [[nodiscard]] bool populate ( std::size_t const g_ ) noexcept {
+        std::scoped_lock lock{ m_mutex };
+        if ( m_populated[ g_ ] )
+            return true; // Filled by another thread meanwhile.
+        sax::win::unique_handle section{ CreateFileMapping ( INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0u,
+                                                             static_cast<DWORD> ( granule_b ), nullptr ) };
+        if ( HEDLEY_UNLIKELY ( not section ) )
+            return false;
+        void * const staging = MapViewOfFile ( section.get ( ), FILE_MAP_WRITE, 0u, 0u, granule_b );
+        if ( HEDLEY_UNLIKELY ( not staging ) )
+            return false;
+        std::size_t const offset_b = g_ * granule_b;
+        try {
+            m_fill ( offset_b, staging, std::min ( granule_b, m_size_b - offset_b ) );
+        }
+        catch ( ... ) {
+            UnmapViewOfFile ( staging );
+            return false;
+        }
+        UnmapViewOfFile ( staging );
+        char * const p = m_data + offset_b;
+        sax::win::split_placeholder ( p, granule_b ); // Fails if it is a granule already.
+        if ( HEDLEY_UNLIKELY ( not sax::win::map_placeholder ( section.get ( ), p, granule_b ) ) )
+            return false;
+        m_populated[ g_ ] = true;
+        ++m_populated_count;
+        return true; // The view keeps the section alive.
+    }
+
+    char * m_data = nullptr;
+    std::size_t m_size_b, m_reserved_b;
+    lazy_fill m_fill;
+    mutable std::mutex m_mutex;
+    std::vector<bool> m_populated;
+    std::size_t m_populated_count = 0u;
+};
+
+// A lazy_fill reading the file at path_, from file_offset_b_ on. Bytes past the end of the file read as 0.
+[[nodiscard]] inline lazy_fill file_fill ( wchar_t const * const path_, std::uint64_t const file_offset_b_ = 0u ) {
+    auto file = std::make_shared<sax::win::unique_handle> (
+        CreateFile ( path_, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr ) );
+    if ( HEDLEY_UNLIKELY ( not *file ) )
+        throw std::runtime_error ( "CreateFile error: " + sax::win::last_error ( ) );
+    return [ file, file_offset_b_ ] ( std::size_t const offset_b_, void * const dst_, std::size_t const size_b_ ) {
+        // Positioned reads on a synchronous handle, safe from concurrent faults.
+        std::size_t done = 0u;
+        while ( done < size_b_ ) {
+            std::uint64_t const at = file_offset_b_ + offset_b_ + done;
+            OVERLAPPED ov{ };
+            ov.Offset     = static_cast<DWORD> ( at );
+            ov.OffsetHigh = static_cast<DWORD> ( at >> 32 );
+            DWORD got     = 0u;
+            if ( not ReadFile ( file->get ( ), static_cast<char *> ( dst_ ) + done, static_cast<DWORD> ( size_b_ - done ),
+                                std::addressof ( got ), std::addressof ( ov ) ) ) {
+                if ( GetLastError ( ) == ERROR_HANDLE_EOF )
+                    return;
+                throw std::runtime_error ( "ReadFile error: " + sax::win::last_error ( ) );
+            }
+            if ( not got )
+                return;
+            done += got;
+        }
+    };
+}
+
+// A fixed size array over a lazy_region. The fill is either a lazy_fill (bytes) or a function taking the
+// index of the first element, a pointer to it and the number of elements, a granule holds a whole number of
+// elements.
+template<typename ValueType, typename SizeType, SizeType Capacity>
+struct vm_lazy_array {
+
+    static_assert ( std::is_trivially_copyable<ValueType>::value, "vm_lazy_array requires a trivially copyable type" );
+    static_assert ( not( lazy_region::granule_b % sizeof ( ValueType ) ), "the element size must divide 64KB" );
+
+    using value_type = ValueType;
+
+    using pointer       = value_type *;
+    using const_pointer = value_type const *;
+
+    using reference       = value_type &;
+    using const_reference = value_type const &;
+
+    using size_type       = SizeType;
+    using difference_type = std::make_signed_t<size_type>;
+
+    using iterator       = pointer;
+    using const_iterator = const_pointer;
+
+    template<typename Fill>
+    explicit vm_lazy_array ( Fill && fill_ ) :
+        m_region{ Capacity * sizeof ( value_type ), make_fill ( std::forward<Fill> ( fill_ ) ) } {}
+
+    [[nodiscard]] static constexpr size_type capacity ( ) noexcept { return Capacity; }
+    [[nodiscard]] static constexpr size_type size ( ) noexcept { return Capacity; }
+    [[nodiscard]] static constexpr size_type max_size ( ) noexcept { return Capacity; }
+
+    [[nodiscard]] const_pointer data ( ) const noexcept { return static_cast<const_pointer> ( m_region.data ( ) ); }
+    [[nodiscard]] pointer data ( ) noexcept { return static_cast<pointer> ( m_region.data ( ) ); }
+
+    [[nodiscard]] const_iterator begin ( ) const noexcept { return data ( ); }
+    [[nodiscard]] const_iterator cbegin ( ) const noexcept { return begin ( ); }
+    [[nodiscard]] iterator begin ( ) noexcept { return data ( ); }
+
+    [[nodiscard]] const_iterator end ( ) const noexcept { return data ( ) + Capacity; }
+    [[nodiscard]] const_iterator cend ( ) const noexcept { return end ( ); }
+    [[nodiscard]] iterator end ( ) noexcept { return data ( ) + Capacity; }
+
+    [[nodiscard]] const_reference operator[] ( size_type const i_ ) const noexcept {
+        assert ( i_ < size ( ) );
+        return data ( )[ i_ ];
+    }
+    [[nodiscard]] reference operator[] ( size_type const i_ ) noexcept {
+        return const_cast<reference> ( std::as_const ( *this )[ i_ ] );
+    }
+
+    [[nodiscard]] const_reference at ( size_type const i_ ) const {
+        if ( HEDLEY_LIKELY ( i_ < size ( ) ) )
+            return data ( )[ i_ ];
+        else
+            throw std::runtime_error ( "index out of bounds" );
+    }
+    [[nodiscard]] reference at ( size_type const i_ ) { return const_cast<reference> ( std::as_const ( *this ).at ( i_ ) ); }
+
+    [[nodiscard]] bool populated ( size_type const i_ ) const noexcept { return m_region.populated ( i_ * sizeof ( value_type ) ); }
+    [[nodiscard]] std::size_t populated_b ( ) const noexcept { return m_region.populated_b ( ); }
+
+    // Fills the elements [ first_, last_ ) ahead of access.
+    void prefetch ( size_type const first_, size_type const last_ ) {
+        m_region.prefetch ( first_ * sizeof ( value_type ), last_ * sizeof ( value_type ) );
+    }
+
+    private:
+    template<typename Fill>
+    [[nodiscard]] static lazy_fill make_fill ( Fill && fill_ ) {
+        if constexpr ( std::is_invocable<Fill &, size_type, pointer, size_type>::value and
+                       not std::is_invocable<Fill &, std::size_t, void *, std::size_t>::value ) {
+            return [ f = std::forward<Fill> ( fill_ ) ] ( std::size_t const offset_b_, void * const dst_,
+                                                          std::size_t const size_b_ ) mutable {
+                f ( static_cast<size_type> ( offset_b_ / sizeof ( value_type ) ), static_cast<pointer> ( dst_ ),
+                    static_cast<size_type> ( size_b_ / sizeof ( value_type ) ) );
+            };
+        }
+        else {
+            return lazy_fill{ std::forward<Fill> ( fill_ ) };
+        }
+    }
+
+    lazy_region m_region;
+};
+
+} // namespace sax
@@ -0,0 +1,175 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef NOMINMAX
+#    define NOMINMAX
+#endif
+
+#include <processthreadsapi.h>
+#include <psapi.h>
+#include <realtimeapiset.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+
+#include <plf/plf_nanotimer.h>
+
+#include <hedley.hpp>
+
+// Scoped instrumentation of container operations and benchmark regions: the time (plf::nanotimer), the cycles
+// of the thread (QueryThreadCycleTime) and the page faults of the process, aggregated per operation type.
+//
+// The hardware counters (dTLB and LLC misses) of Windows are only available to ETW kernel sessions, run as
+// administrator, not to a process counting its own events, so they are reported as n/a: the counts degrade to
+// the software events. The fault count is the total (soft and hard) of the process, other threads faulting at
+// the same time are counted as well.
+
+namespace sax::perf {
+
+enum class op : int { append, commit, scan, copy, other };
+
+inline constexpr std::size_t op_count = 5u;
+
+[[nodiscard]] constexpr char const * name ( op const o_ ) noexcept {
+    switch ( o_ ) {
+        case op::append: return "append";
+        case op::commit: return "commit";
+        case op::scan: return "scan";
+        case op::copy: return "copy";
+        default: return "other";
+    }
+}
+
+// Whether dTLB and LLC misses are counted.
+inline constexpr bool hardware_counters = false;
+
+[[nodiscard]] inline std::uint64_t thread_cycles ( ) noexcept {
+    ULONG64 c = 0u;
+    QueryThreadCycleTime ( GetCurrentThread ( ), std::addressof ( c ) );
+    return c;
+}
+
+[[nodiscard]] inline std::uint64_t process_faults ( ) noexcept {
+    PROCESS_MEMORY_COUNTERS pmc;
+    pmc.cb = sizeof ( pmc );
+    if ( HEDLEY_UNLIKELY ( not GetProcessMemoryInfo ( GetCurrentProcess ( ), std::addressof ( pmc ), sizeof ( pmc ) ) ) )
+        return 0u;
+    return pmc.PageFaultCount;
+}
+
+struct totals {
+    std::uint64_t calls = 0u, ns = 0u, cycles = 0u, faults = 0u;
+};
+
+// The totals per operation type, safe to add to from several threads.
+struct registry {
+
+    void add ( op const o_, std::uint64_t const ns_, std::uint64_t const cycles_, std::uint64_t const faults_ ) noexcept {
+        slot & s = m_slots[ static_cast<std::size_t> ( o_ ) ];
+        s.calls.fetch_add ( 1u, std::memory_order_relaxed );
+        s.ns.fetch_add ( ns_, std::memory_order_relaxed );
+        s.cycles.fetch_add ( cycles_, std::memory_order_relaxed );
+        s.faults.fetch_add ( faults_, std::memory_order_relaxed );
+    }
+
+    [[nodiscard]] totals get ( op const o_ ) const noexcept {
+        slot const & s = m_slots[ static_cast<std::size_t> ( o_ ) ];
+        return { s.calls.load ( std::memory_order_relaxed ), s.ns.load ( std::memory_order_relaxed ),
+                 s.cycles.load ( std::memory_order_relaxed ), s.faults.load ( std::memory_order_relaxed ) };
+    }
+
+    void reset ( ) noexcept {
+        for ( slot & s : m_slots ) {
+            s.calls.store ( 0u, std::memory_order_relaxed );
+            s.ns.store ( 0u, std::memory_order_relaxed );
+            s.cycles.store ( 0u, std::memory_order_relaxed );
+            s.faults.store ( 0u, std::memory_order_relaxed );
+        }
+    }
+
+    // A CSV table of the operation types that were measured.
+    void report ( std::ostream & out_ ) const {
+        out_ << "op,calls,ns,cycles,faults,dtlb_misses,llc_misses\n";
+        for ( std::size_t i = 0u; i < op_count; ++i ) {
+            totals const t = get ( static_cast<op> ( i ) );
+            if ( t.calls )
+                out_ << name ( static_cast<op> ( i ) ) << ',' << t.calls << ',' << t.ns << ',' << t.cycles << ',' << t.faults
+                     << ",n/a,n/a\n";
+        }
+    }
+
+    [[nodiscard]] static registry & global ( ) noexcept {
+        static registry r;
+        return r;
+    }
+
+    private:
+    struct slot {
+        std::atomic<std::uint64_t> calls{ 0u }, ns{ 0u }, cycles{ 0u }, faults{ 0u };
+    };
+
+    std::array<slot, op_count> m_slots;
+};
+
+// Measures its lifetime, on the thread that constructs it, and adds it to the registry as an o_.
+struct scope {
+
+    explicit scope ( op const o_, registry & r_ = registry::global ( ) ) noexcept :
+        m_registry{ r_ }, m_op{ o_ }, m_faults{ process_faults ( ) }, m_cycles{ thread_cycles ( ) } {
+        m_timer.start ( );
+    }
+
+    scope ( scope const & )             = delete;
+    scope & operator= ( scope const & ) = delete;
+
+    ~scope ( ) noexcept {
+        double const ns = m_timer.get_elapsed_ns ( );
+        m_registry.add ( m_op, static_cast<std::uint64_t> ( ns ), thread_cycles ( ) - m_cycles, process_faults ( ) - m_faults );
+    }
+
+    private:
+    registry & m_registry;
+    op m_op;
+    std::uint64_t m_faults, m_cycles;
+    plf::nanotimer m_timer;
+};
+
+// Calls f_ ( ) inside a scope, returns what it returns.
+template<typename Function>
+decltype ( auto ) measure ( op const o_, Function && f_ ) {
+    scope s{ o_ };
+    return std::forward<Function> ( f_ ) ( );
+}
+
+} // namespace sax::perf
@@ -0,0 +1,286 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#include <immintrin.h>
+
+#include <hedley.hpp>
+
+#include "bit_ops.hpp"
+#include "growth_policy.hpp"
+#include "vm_backed.hpp"
+#include "vm_simd.hpp"
+
+// AVX2 selection of the best of a group of children, for the element types of vm_simd.hpp ordered by
+// std::less or std::greater.
+
+namespace sax::simd {
+
+#if defined( __clang__ )
+#    pragma clang attribute push( __attribute__( ( target( "avx2,bmi,bmi2,popcnt,lzcnt" ) ) ), apply_to = function )
+#elif defined( __GNUC__ )
+#    pragma GCC push_options
+#    pragma GCC target( "avx2,bmi,bmi2,popcnt,lzcnt" )
+#endif
+
+namespace avx2 {
+
+// Index of the (first) maximum (Max) or minimum of p_[ 0 ], .., p_[ N - 1 ], N a multiple of the width.
+template<typename T, std::size_t N, bool Max>
+[[nodiscard]] std::size_t select_child ( T const * p_ ) noexcept {
+    using V = traits<T>;
+    static_assert ( N % V::width == 0u, "select_child requires whole vectors" );
+    typename V::vec m = V::load ( p_ );
+    for ( std::size_t i = V::width; i < N; i += V::width )
+        m = Max ? V::max ( m, V::load ( p_ + i ) ) : V::min ( m, V::load ( p_ + i ) );
+    typename V::vec const b = V::set1 ( Max ? horizontal_max<T> ( m ) : horizontal_min<T> ( m ) );
+    std::size_t i           = 0u;
+    for ( ; i + V::width < N; i += V::width ) {
+        if ( std::uint64_t const e = V::template compare<cmp::eq> ( V::load ( p_ + i ), b ) )
+            return i + static_cast<std::size_t> ( sax::countr_zero ( e ) );
+    }
+    return i + static_cast<std::size_t> ( sax::countr_zero ( V::template compare<cmp::eq> ( V::load ( p_ + i ), b ) ) );
+}
+
+} // namespace avx2
+
+#if defined( __clang__ )
+#    pragma clang attribute pop
+#elif defined( __GNUC__ )
+#    pragma GCC pop_options
+#endif
+
+} // namespace sax::simd
+
+namespace sax {
+
+// The arity that makes a group of children (at least) a cache line.
+template<typename ValueType>
+inline constexpr std::size_t cache_line_arity = std::max<std::size_t> ( 64u / sizeof ( ValueType ), 2u );
+
+// A d-ary heap (top ( ) is the greatest element according to Compare, like std::priority_queue) on
+// vm_vector storage, so growing it commits pages in place and never copies (or moves) the heap.
+//
+// The children of node i are the nodes d * i + 1, .., d * i + d. The heap starts at index d - 1 of the
+// (page-aligned) storage, the first child of every node then sits at a multiple of d, so with
+// d * sizeof ( ValueType ) a multiple of 64 every group of children is a cache line (or several) and sifting
+// down touches one line per level. Where the element type is one of std::int32_t, float or double, Compare
+// std::less or std::greater and a group is made of whole AVX2 vectors, the best child is selected with AVX2.
+//
+// push_range ( ) heapifies (Floyd) when the batch is large compared to the heap, pop_n ( ) pops in order.
+
+template<typename ValueType, typename SizeType, SizeType Capacity, typename Compare = std::less<ValueType>,
+         std::size_t Arity     = cache_line_arity<ValueType>,
+         typename GrowthPolicy = linear_growth_policy<SizeType, static_cast<SizeType> ( 1'600 * 65'536 )>>
+struct vm_priority_queue {
+
+    static_assert ( Arity >= 2u, "vm_priority_queue requires an arity of at least 2" );
+
+    using value_type = ValueType;
+
+    using pointer       = value_type *;
+    using const_pointer = value_type const *;
+
+    using reference       = value_type &;
+    using const_reference = value_type const &;
+
+    using size_type       = SizeType;
+    using difference_type = std::make_signed_t<size_type>;
+
+    using value_compare = Compare;
+
+    static constexpr std::size_t arity = Arity;
+
+    using container_type = vm_vector<value_type, size_type, static_cast<size_type> ( Capacity + arity - 1u ), GrowthPolicy>;
+
+    explicit vm_priority_queue ( Compare const & c_ = Compare{ } ) : m_compare{ c_ } {
+        for ( std::size_t i = 0u; i < padding; ++i )
+            m_data.emplace_back ( );
+    }
+
+    template<typename InputIt>
+    vm_priority_queue ( InputIt first_, InputIt last_, Compare const & c_ = Compare{ } ) : vm_priority_queue{ c_ } {
+        push_range ( first_, last_ );
+    }
+
+    vm_priority_queue ( vm_priority_queue const & )             = delete;
+    vm_priority_queue & operator= ( vm_priority_queue const & ) = delete;
+
+    // Size.
+
+    [[nodiscard]] static constexpr size_type capacity ( ) noexcept { return Capacity; }
+    [[nodiscard]] static constexpr size_type max_size ( ) noexcept { return capacity ( ); }
+    [[nodiscard]] size_type size ( ) const noexcept { return static_cast<size_type> ( m_data.size ( ) - padding ); }
+    [[nodiscard]] bool empty ( ) const noexcept { return not size ( ); }
+
+    // Commits the pages required to hold n_ elements.
+    void reserve ( size_type const n_ ) { m_data.reserve ( static_cast<size_type> ( n_ + padding ) ); }
+
+    // Access.
+
+    [[nodiscard]] const_reference top ( ) const noexcept {
+        assert ( size ( ) );
+        return heap ( )[ 0 ];
+    }
+
+    // The heap in storage order.
+    [[nodiscard]] const_pointer data ( ) const noexcept { return heap ( ); }
+
+    // Modify.
+
+    template<typename... Args>
+    void emplace ( Args &&... args_ ) {
+        m_data.emplace_back ( std::forward<Args> ( args_ )... );
+        sift_up ( heap ( ), size ( ) - 1u );
+    }
+    void push ( value_type const & v_ ) { emplace ( v_ ); }
+    void push ( value_type && v_ ) { emplace ( std::move ( v_ ) ); }
+
+    // Pushes [ first_, last_ ). A batch that is large compared to the heap is appended as a whole and the heap
+    // rebuilt bottom-up in O ( n ), a small one is sifted up element by element in O ( k log_d n ).
+    template<typename InputIt>
+    void push_range ( InputIt first_, InputIt last_ ) {
+        size_type const n0 = size ( );
+        for ( ; first_ != last_; ++first_ )
+            m_data.emplace_back ( *first_ );
+        size_type const n = size ( ), k = n - n0;
+        pointer const h = heap ( );
+        if ( static_cast<std::size_t> ( k ) * depth ( n ) > static_cast<std::size_t> ( n ) ) {
+            if ( n > 1u ) {
+                for ( size_type i = static_cast<size_type> ( ( n - 2u ) / arity + 1u ); i--; )
+                    sift_down ( h, i, n );
+            }
+        }
+        else {
+            for ( size_type i = n0; i < n; ++i )
+                sift_up ( h, i );
+        }
+    }
+
+    void pop ( ) {
+        assert ( size ( ) );
+        pointer const h   = heap ( );
+        size_type const n = size ( ) - 1u;
+        if ( n )
+            h[ 0 ] = std::move ( h[ n ] );
+        m_data.pop_back ( );
+        if ( n > 1u )
+            sift_down ( h, 0u, n );
+    }
+
+    // Pops (up to) n_ elements, in order, to out_, returns the number popped.
+    template<typename OutputIt>
+    [[maybe_unused]] size_type pop_n ( OutputIt out_, size_type n_ ) {
+        n_ = std::min ( n_, size ( ) );
+        for ( size_type i = 0u; i < n_; ++i ) {
+            *out_++ = std::move ( heap ( )[ 0 ] );
+            pop ( );
+        }
+        return n_;
+    }
+
+    void clear ( ) noexcept {
+        while ( m_data.size ( ) > padding )
+            m_data.pop_back ( );
+    }
+
+    private:
+    static constexpr std::size_t padding = arity - 1u;
+
+    static constexpr bool simd_select =
+        simd::is_vectorized<value_type> and
+        ( std::is_same<Compare, std::less<value_type>>::value or std::is_same<Compare, std::less<>>::value or
+          std::is_same<Compare, std::greater<value_type>>::value or std::is_same<Compare, std::greater<>>::value ) and
+        not( arity * sizeof ( value_type ) % 32u );
+    static constexpr bool select_max =
+        not std::is_same<Compare, std::greater<value_type>>::value and not std::is_same<Compare, std::greater<>>::value;
+
+    [[nodiscard]] const_pointer heap ( ) const noexcept { return m_data.data ( ) + padding; }
+    [[nodiscard]] pointer heap ( ) noexcept { return m_data.data ( ) + padding; }
+
+    // Levels of a heap of n_ elements.
+    [[nodiscard]] static std::size_t depth ( size_type n_ ) noexcept {
+        std::size_t d = 1u;
+        for ( ; n_ > 1u; n_ = static_cast<size_type> ( ( n_ - 1u ) / arity ) )
+            ++d;
+        return d;
+    }
+
+    // The best of the children [ first_, last_ ).
+    [[nodiscard]] size_type best_child ( const_pointer h_, size_type const first_, size_type const last_ ) const noexcept {
+        if constexpr ( simd_select ) {
+            if ( HEDLEY_LIKELY ( last_ - first_ == arity and simd::cpu_isa != simd::isa::scalar ) )
+                return static_cast<size_type> ( first_ + simd::avx2::select_child<value_type, arity, select_max> ( h_ + first_ ) );
+        }
+        size_type b = first_;
+        for ( size_type c = first_ + 1u; c < last_; ++c ) {
+            if ( m_compare ( h_[ b ], h_[ c ] ) )
+                b = c;
+        }
+        return b;
+    }
+
+    void sift_up ( pointer h_, size_type i_ ) {
+        value_type v = std::move ( h_[ i_ ] );
+        while ( i_ ) {
+            size_type const p = static_cast<size_type> ( ( i_ - 1u ) / arity );
+            if ( not m_compare ( h_[ p ], v ) )
+                break;
+            h_[ i_ ] = std::move ( h_[ p ] );
+            i_       = p;
+        }
+        h_[ i_ ] = std::move ( v );
+    }
+
+    void sift_down ( pointer h_, size_type i_, size_type const n_ ) {
+        value_type v = std::move ( h_[ i_ ] );
+        for ( ;; ) {
+            size_type const first = static_cast<size_type> ( arity * i_ + 1u );
+            if ( first >= n_ )
+                break;
+            size_type const c = best_child ( h_, first, static_cast<size_type> ( std::min<std::size_t> ( first + arity, n_ ) ) );
+            if ( not m_compare ( v, h_[ c ] ) )
+                break;
+            h_[ i_ ] = std::move ( h_[ c ] );
+            i_       = c;
+        }
+        h_[ i_ ] = std::move ( v );
+    }
+
+    container_type m_data;
+    Compare m_compare;
+};
+
+} // namespace sax
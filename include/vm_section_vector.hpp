@@ -0,0 +1,319 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef NOMINMAX
+#    define NOMINMAX
+#endif
+
+#include <Memoryapi.h>
+#include <handleapi.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <hedley.hpp>
+
+#include "winsys.hpp"
+
+// A vector whose pages can be handed to another vector without copying them.
+//
+// The reservation is a placeholder, the storage a sequence of granules, each one a (pagefile backed) section
+// mapped into its slot of the placeholder. Splicing a vector onto the end of another one maps the sections of
+// the source into the free slots of the destination and unmaps them from the source, the cost is that of the
+// page table updates, not of the bytes. That requires the end of the destination to fall on a granule
+// boundary, the partial granule at the end of the source (and everything, if the destination is not aligned)
+// is copied.
+
+namespace sax {
+
+template<typename ValueType, typename SizeType, SizeType Capacity, std::size_t GranuleB = 2'097'152u>
+struct vm_section_vector {
+
+    static_assert ( std::is_trivially_copyable<ValueType>::value, "vm_section_vector requires a trivially copyable type" );
+    static_assert ( not( GranuleB % 65'536u ), "the granule size must be a multiple of 64KB" );
+    static_assert ( not( GranuleB % sizeof ( ValueType ) ), "the element size must divide the granule size" );
+
+    using value_type = ValueType;
+
+    using pointer       = value_type *;
+    using const_pointer = value_type const *;
+
+    using reference       = value_type &;
+    using const_reference = value_type const &;
+
+    using size_type       = SizeType;
+    using difference_type = std::make_signed_t<size_type>;
+
+    using iterator       = pointer;
+    using const_iterator = const_pointer;
+
+    static constexpr std::size_t granule_b = GranuleB;
+
+    vm_section_vector ( ) : m_data{ static_cast<char *> ( sax::win::reserve_placeholder ( reserved_b ) ) } {
+        if ( HEDLEY_UNLIKELY ( not m_data ) )
+            throw std::bad_alloc ( );
+    }
+
+    vm_section_vector ( vm_section_vector const & )             = delete;
+    vm_section_vector & operator= ( vm_section_vector const & ) = delete;
+
+    ~vm_section_vector ( ) noexcept {
+        if ( HEDLEY_LIKELY ( m_data ) ) {
+            clear ( );
+            sax::win::release_placeholders ( m_data, reserved_b );
+            m_data = nullptr;
+        }
+    }
+
+    // Size.
+
+    [[nodiscard]] static constexpr size_type capacity ( ) noexcept { return Capacity; }
+    [[nodiscard]] static constexpr size_type max_size ( ) noexcept { return Capacity; }
+    [[nodiscard]] size_type size ( ) const noexcept { return m_size; }
+    [[nodiscard]] bool empty ( ) const noexcept { return not m_size; }
+    [[nodiscard]] std::size_t mapped_b ( ) const noexcept { return m_sections.size ( ) * granule_b; }
+
+    // Access.
+
+    [[nodiscard]] const_pointer data ( ) const noexcept { return reinterpret_cast<const_pointer> ( m_data ); }
+    [[nodiscard]] pointer data ( ) noexcept { return reinterpret_cast<pointer> ( m_data ); }
+
+    [[nodiscard]] const_iterator begin ( ) const noexcept { return data ( ); }
+    [[nodiscard]] const_iterator cbegin ( ) const noexcept { return begin ( ); }
+    [[nodiscard]] iterator begin ( ) noexcept { return data ( ); }
+
+    [[nodiscard]] const_iterator end ( ) const noexcept { return data ( ) + m_size; }
+    [[nodiscard]] const_iterator cend ( ) const noexcept { return end ( ); }
+    [[nodiscard]] iterator end ( ) noexcept { return data ( ) + m_size; }
+
+    [[nodiscard]] const_reference front ( ) const noexcept { return *begin ( ); }
+    [[nodiscard]] reference front ( ) noexcept { return *begin ( ); }
+
+    [[nodiscard]] const_reference back ( ) const noexcept { return *( end ( ) - 1 ); }
+    [[nodiscard]] reference back ( ) noexcept { return *( end ( ) - 1 ); }
+
+    [[nodiscard]] const_reference operator[] ( size_type const i_ ) const noexcept {
+        assert ( i_ < size ( ) );
+        return data ( )[ i_ ];
+    }
+    [[nodiscard]] reference operator[] ( size_type const i_ ) noexcept {
+        return const_cast<reference> ( std::as_const ( *this )[ i_ ] );
+    }
+
+    [[nodiscard]] const_reference at ( size_type const i_ ) const {
+        if ( HEDLEY_LIKELY ( i_ < size ( ) ) )
+            return data ( )[ i_ ];
+        else
+            throw std::runtime_error ( "index out of bounds" );
+    }
+    [[nodiscard]] reference at ( size_type const i_ ) { return const_cast<reference> ( std::as_const ( *this ).at ( i_ ) ); }
+
+    // Modify.
+
+    template<typename... Args>
+    [[maybe_unused]] reference emplace_back ( Args &&... args_ ) {
+        if ( HEDLEY_UNLIKELY ( m_size == capacity ( ) ) )
+            throw std::bad_alloc ( );
+        map_to ( size_b ( ) + sizeof ( value_type ) );
+        new ( end ( ) ) value_type{ std::forward<Args> ( args_ )... };
+        ++m_size;
+        return back ( );
+    }
+    [[maybe_unused]] reference push_back ( const_reference v_ ) { return emplace_back ( v_ ); }
+
+    // Copies [ p_, p_ + n_ ) to the end.
+    void append ( const_pointer const p_, size_type const n_ ) {
+        if ( HEDLEY_UNLIKELY ( n_ > capacity ( ) - size ( ) ) )
+            throw std::bad_alloc ( );
+        map_to ( size_b ( ) + n_ * sizeof ( value_type ) );
+        std::memcpy ( end ( ), p_, n_ * sizeof ( value_type ) );
+        m_size += n_;
+    }
+
+    void pop_back ( ) noexcept {
+        assert ( m_size );
+        --m_size;
+    }
+
+    // Unmaps the granules past the end.
+    void shrink_to_fit ( ) noexcept {
+        while ( mapped_b ( ) >= size_b ( ) + granule_b )
+            unmap_back ( );
+    }
+
+    void clear ( ) noexcept {
+        m_size = 0u;
+        shrink_to_fit ( );
+    }
+
+    // Moves the elements of src_ to the end, leaves src_ empty. Whole granules are remapped (if the end falls on
+    // a granule boundary), only the remainder is copied.
+    void splice ( vm_section_vector & src_ ) {
+        assert ( std::addressof ( src_ ) != this );
+        splice_granules ( src_ );
+        append ( src_.data ( ), src_.size ( ) );
+        src_.clear ( );
+    }
+
+    // Moves the whole granules of src_ to the end, if the end falls on a granule boundary, by remapping them,
+    // returns the number of elements moved. The remainder (less than a granule) is left in src_. If mapping a
+    // granule fails, the granules moved before it stay moved and src_ holds the rest.
+    [[maybe_unused]] size_type splice_granules ( vm_section_vector & src_ ) {
+        assert ( std::addressof ( src_ ) != this );
+        std::size_t const whole = src_.size_b ( ) / granule_b;
+        if ( size_b ( ) % granule_b or not whole )
+            return 0u;
+        if ( HEDLEY_UNLIKELY ( src_.size ( ) > capacity ( ) - size ( ) ) )
+            throw std::bad_alloc ( );
+        shrink_to_fit ( );
+        src_.shrink_to_fit ( );
+        m_sections.reserve ( m_sections.size ( ) + whole ); // So a granule mapped is a granule recorded.
+        std::size_t g = 0u;
+        try {
+            for ( ; g < whole; ++g ) {
+                map_back ( src_.m_sections[ g ] );
+                sax::win::unmap_placeholder ( src_.m_data + g * granule_b );
+                m_size += per_granule;
+            }
+        }
+        catch ( ... ) {
+            src_.drop_front ( g );
+            throw;
+        }
+        src_.drop_front ( whole );
+        return static_cast<size_type> ( whole * per_granule );
+    }
+
+    private:
+    static constexpr std::size_t reserved_b = ( Capacity * sizeof ( value_type ) + granule_b - 1u ) / granule_b * granule_b;
+
+    static constexpr size_type per_granule = static_cast<size_type> ( granule_b / sizeof ( value_type ) );
+
+    [[nodiscard]] std::size_t size_b ( ) const noexcept { return m_size * sizeof ( value_type ); }
+
+    // Drops the first n_ granules, their sections moved out and unmapped already, moves the rest to the front,
+    // in place. It runs on the failure path of splice_granules ( ), so it can not fail: a section remapped into
+    // a slot just vacated only fails to map when the system is out of resources, then it terminates.
+    void drop_front ( std::size_t const n_ ) noexcept {
+        if ( not n_ )
+            return;
+        m_size -= static_cast<size_type> ( n_ * per_granule );
+        std::size_t const mapped = m_sections.size ( );
+        for ( std::size_t g = n_; g < mapped; ++g ) {
+            sax::win::unmap_placeholder ( m_data + g * granule_b );
+            if ( HEDLEY_UNLIKELY (
+                     not sax::win::map_placeholder ( m_sections[ g ].get ( ), m_data + ( g - n_ ) * granule_b, granule_b ) ) )
+                std::terminate ( );
+            m_sections[ g - n_ ] = std::move ( m_sections[ g ] );
+        }
+        m_sections.erase ( m_sections.end ( ) - static_cast<std::ptrdiff_t> ( n_ ), m_sections.end ( ) );
+    }
+
+    // Maps the section of h_ into the next slot, takes h_ on success.
+    void map_back ( sax::win::unique_handle & h_ ) {
+        char * const p = m_data + mapped_b ( );
+        sax::win::split_placeholder ( p, granule_b ); // Fails if it is a granule already.
+        if ( HEDLEY_UNLIKELY ( not sax::win::map_placeholder ( h_.get ( ), p, granule_b ) ) )
+            throw std::runtime_error ( "MapViewOfFile3 error: " + sax::win::last_error ( ) );
+        m_sections.push_back ( std::move ( h_ ) );
+    }
+
+    void unmap_back ( ) noexcept {
+        sax::win::unmap_placeholder ( m_data + mapped_b ( ) - granule_b );
+        m_sections.pop_back ( );
+    }
+
+    // Maps fresh granules until size_b_ bytes are mapped.
+    void map_to ( std::size_t const size_b_ ) {
+        while ( mapped_b ( ) < size_b_ ) {
+            sax::win::unique_handle section{ CreateFileMapping ( INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                                                 static_cast<DWORD> ( std::uint64_t{ granule_b } >> 32 ),
+                                                                 static_cast<DWORD> ( granule_b ), nullptr ) };
+            if ( HEDLEY_UNLIKELY ( not section ) )
+                throw std::bad_alloc ( );
+            map_back ( section );
+        }
+    }
+
+    char * m_data;
+    std::vector<sax::win::unique_handle> m_sections; // One per mapped granule, in slot order.
+    size_type m_size = 0u;
+};
+
+// Hands out one vm_section_vector per thread, to be filled independently, and merges them into one.
+template<typename ValueType, typename SizeType, SizeType Capacity, std::size_t GranuleB = 2'097'152u>
+struct vm_sharded_builder {
+
+    using vector_type = vm_section_vector<ValueType, SizeType, Capacity, GranuleB>;
+
+    explicit vm_sharded_builder ( std::size_t const shards_ = std::max ( std::thread::hardware_concurrency ( ), 1u ) ) {
+        m_shards.reserve ( shards_ );
+        for ( std::size_t i = 0u; i < shards_; ++i )
+            m_shards.push_back ( std::make_unique<vector_type> ( ) );
+    }
+
+    [[nodiscard]] std::size_t shards ( ) const noexcept { return m_shards.size ( ); }
+
+    // The shard of thread i_, no two threads may use the same shard.
+    [[nodiscard]] vector_type & shard ( std::size_t const i_ ) noexcept {
+        assert ( i_ < shards ( ) );
+        return *m_shards[ i_ ];
+    }
+
+    // Splices the shards, in order, onto the end of out_. After the first shard whose size is not a whole number
+    // of granules the destination is no longer aligned and the shards that follow are copied.
+    void merge ( vector_type & out_ ) {
+        for ( std::unique_ptr<vector_type> & s : m_shards )
+            out_.splice ( *s );
+    }
+
+    // Splices the whole granules of all shards first, in shard order, then the remainders, so at most one
+    // granule per shard is copied (if out_ is aligned). The elements of a shard stay in order, except for the
+    // remainder, which ends up after the granules of all shards.
+    void merge_unordered ( vector_type & out_ ) {
+        for ( std::unique_ptr<vector_type> & s : m_shards )
+            out_.splice_granules ( *s );
+        for ( std::unique_ptr<vector_type> & s : m_shards )
+            out_.splice ( *s );
+    }
+
+    private:
+    std::vector<std::unique_ptr<vector_type>> m_shards;
+};
+
+} // namespace sax
@@ -0,0 +1,320 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef NOMINMAX
+#    define NOMINMAX
+#endif
+
+#include <Memoryapi.h>
+#include <handleapi.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include <hedley.hpp>
+
+#include "growth_policy.hpp"
+#include "winsys.hpp"
+
+// A vm_vector shared between processes. The storage is a named, pagefile backed section created with
+// SEC_RESERVE (the shm_open/memfd of Windows): every process maps a view of the full capacity, which only
+// reserves address space, the producer commits the pages of the section as it grows and those pages are
+// then accessible through every view, so a consumer view never needs to grow or be remapped. A header in
+// the first page holds the size and the committed bytes, atomically: the producer writes the elements and
+// then publishes the new size (release), a consumer reads the size (acquire) and then the elements, in
+// place, no copy.
+//
+// There is one producer, a vm_shared_vector, which creates the section, and any number of consumers, a
+// vm_shared_vector_reader each, which open it (read-only) by name. The pages of a section can not be
+// decommitted, the vector does not shrink.
+
+namespace sax {
+
+// Thrown opening a section the producer has not initialized yet, opening it later can succeed.
+struct shared_vector_not_ready : std::runtime_error {
+    shared_vector_not_ready ( ) : std::runtime_error{ "vm_shared_vector: the section is not ready" } {}
+};
+
+namespace detail {
+
+// The view of the section and the read access, common to the producer and the consumers.
+template<typename ValueType, typename SizeType, SizeType Capacity>
+struct shared_vector_base {
+
+    static_assert ( std::is_trivially_copyable<ValueType>::value, "vm_shared_vector requires a trivially copyable type" );
+    static_assert ( std::atomic<std::uint64_t>::is_always_lock_free, "vm_shared_vector requires lock-free 64-bit atomics" );
+
+    using value_type = ValueType;
+
+    using pointer       = value_type *;
+    using const_pointer = value_type const *;
+
+    using reference       = value_type &;
+    using const_reference = value_type const &;
+
+    using size_type       = SizeType;
+    using difference_type = std::make_signed_t<size_type>;
+
+    using iterator       = pointer;
+    using const_iterator = const_pointer;
+
+    shared_vector_base ( shared_vector_base const & )             = delete;
+    shared_vector_base & operator= ( shared_vector_base const & ) = delete;
+
+    // Size, as published by the producer.
+
+    [[nodiscard]] static constexpr size_type capacity ( ) noexcept { return Capacity; }
+    [[nodiscard]] static constexpr size_type max_size ( ) noexcept { return capacity ( ); }
+    [[nodiscard]] size_type size ( ) const noexcept {
+        return static_cast<size_type> ( hdr ( ).size.load ( std::memory_order_acquire ) );
+    }
+    [[nodiscard]] bool empty ( ) const noexcept { return not size ( ); }
+    [[nodiscard]] size_type committed ( ) const noexcept {
+        return static_cast<size_type> ( hdr ( ).committed_b.load ( std::memory_order_acquire ) / sizeof ( value_type ) );
+    }
+
+    // Access, elements [ 0, size ( ) ) are valid.
+
+    [[nodiscard]] const_pointer data ( ) const noexcept { return reinterpret_cast<const_pointer> ( m_view + header_b ); }
+
+    [[nodiscard]] const_iterator begin ( ) const noexcept { return data ( ); }
+    [[nodiscard]] const_iterator cbegin ( ) const noexcept { return begin ( ); }
+
+    [[nodiscard]] const_iterator end ( ) const noexcept { return data ( ) + size ( ); }
+    [[nodiscard]] const_iterator cend ( ) const noexcept { return end ( ); }
+
+    [[nodiscard]] const_reference operator[] ( size_type const i_ ) const noexcept {
+        assert ( i_ < size ( ) );
+        return data ( )[ i_ ];
+    }
+
+    [[nodiscard]] const_reference at ( size_type const i_ ) const {
+        if ( HEDLEY_LIKELY ( i_ < size ( ) ) )
+            return data ( )[ i_ ];
+        else
+            throw std::runtime_error ( "index out of bounds" );
+    }
+
+    protected:
+    struct header {
+        static constexpr std::uint64_t magic_value = 0x5341'5853'4856'4543ull; // "SAXSHVEC".
+
+        std::atomic<std::uint64_t> magic; // Stored last (release), the header is valid once it reads right.
+        std::uint32_t value_size, reserved;
+        std::uint64_t capacity;
+        std::atomic<std::uint64_t> size;
+        std::atomic<std::uint64_t> committed_b;
+    };
+
+    static constexpr std::size_t page_size_b = 65'536u;
+    static constexpr std::size_t header_b    = 4'096u; // A system page, the data stays page aligned.
+
+    shared_vector_base ( ) noexcept = default;
+
+    ~shared_vector_base ( ) {
+        if ( HEDLEY_LIKELY ( m_view ) ) {
+            UnmapViewOfFile ( m_view );
+            m_view = nullptr;
+        }
+    }
+
+    [[nodiscard]] static constexpr std::size_t round_up ( std::size_t const b_ ) noexcept {
+        return ( b_ + page_size_b - 1u ) / page_size_b * page_size_b;
+    }
+    [[nodiscard]] static constexpr std::size_t required_b ( size_type const n_ ) noexcept {
+        return round_up ( static_cast<std::size_t> ( n_ ) * sizeof ( value_type ) );
+    }
+    [[nodiscard]] static constexpr std::size_t capacity_b ( ) noexcept { return required_b ( Capacity ); }
+
+    [[nodiscard]] header const & hdr ( ) const noexcept { return *reinterpret_cast<header const *> ( m_view ); }
+    [[nodiscard]] header & hdr ( ) noexcept { return *reinterpret_cast<header *> ( m_view ); }
+
+    void map ( DWORD const access_ ) {
+        m_view = static_cast<char *> ( MapViewOfFile ( m_section.get ( ), access_, 0u, 0u, header_b + capacity_b ( ) ) );
+        if ( HEDLEY_UNLIKELY ( not m_view ) )
+            throw std::runtime_error ( "MapViewOfFile error: " + sax::win::last_error ( ) );
+    }
+
+    sax::win::unique_handle m_section;
+    char * m_view = nullptr;
+};
+
+} // namespace detail
+
+// The producer, creates the section and writes the vector.
+template<typename ValueType, typename SizeType, SizeType Capacity, typename GrowthPolicy = growth_policy<SizeType>>
+struct vm_shared_vector : detail::shared_vector_base<ValueType, SizeType, Capacity> {
+
+    using base = detail::shared_vector_base<ValueType, SizeType, Capacity>;
+
+    using typename base::const_pointer;
+    using typename base::const_reference;
+    using typename base::iterator;
+    using typename base::pointer;
+    using typename base::reference;
+    using typename base::size_type;
+    using typename base::value_type;
+
+    using base::begin;
+    using base::data;
+    using base::end;
+    using base::size;
+    using base::operator[];
+    using base::at;
+
+    // Creates the section name_ (which must not exist) and maps it, for writing.
+    explicit vm_shared_vector ( wchar_t const * const name_ ) {
+        std::uint64_t const total_b = base::header_b + base::capacity_b ( );
+        m_section.reset ( CreateFileMapping ( INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE | SEC_RESERVE,
+                                              static_cast<DWORD> ( total_b >> 32 ), static_cast<DWORD> ( total_b ), name_ ) );
+        if ( HEDLEY_UNLIKELY ( not m_section ) )
+            throw std::runtime_error ( "CreateFileMapping error: " + sax::win::last_error ( ) );
+        if ( HEDLEY_UNLIKELY ( GetLastError ( ) == ERROR_ALREADY_EXISTS ) )
+            throw std::runtime_error ( "vm_shared_vector: the section exists already" );
+        base::map ( FILE_MAP_WRITE );
+        if ( HEDLEY_UNLIKELY ( not VirtualAlloc ( m_view, base::header_b, MEM_COMMIT, PAGE_READWRITE ) ) )
+            throw std::bad_alloc ( ); // The base unmaps the view.
+        typename base::header * h = new ( m_view ) typename base::header{ };
+        h->value_size             = sizeof ( value_type );
+        h->capacity               = static_cast<std::uint64_t> ( Capacity );
+        h->magic.store ( base::header::magic_value, std::memory_order_release );
+    }
+
+    // Access, elements [ 0, size ( ) ) are valid.
+
+    [[nodiscard]] pointer data ( ) noexcept { return const_cast<pointer> ( std::as_const ( *this ).data ( ) ); }
+    [[nodiscard]] iterator begin ( ) noexcept { return data ( ); }
+    [[nodiscard]] iterator end ( ) noexcept { return data ( ) + size ( ); }
+
+    [[nodiscard]] reference operator[] ( size_type const i_ ) noexcept {
+        return const_cast<reference> ( std::as_const ( *this )[ i_ ] );
+    }
+    [[nodiscard]] reference at ( size_type const i_ ) { return const_cast<reference> ( std::as_const ( *this ).at ( i_ ) ); }
+
+    // Modify.
+
+    // Commits the pages required to hold n_ elements (capped at the capacity).
+    void reserve ( size_type const n_ ) { commit_b ( std::min ( base::required_b ( n_ ), base::capacity_b ( ) ) ); }
+
+    template<typename... Args>
+    [[maybe_unused]] reference emplace_back ( Args &&... args_ ) {
+        size_type const s = size ( );
+        if ( HEDLEY_UNLIKELY ( s == Capacity ) )
+            throw std::bad_alloc ( );
+        grow_to ( s + 1u );
+        pointer p = new ( data ( ) + s ) value_type{ std::forward<Args> ( args_ )... };
+        publish ( s + 1u );
+        return *p;
+    }
+    [[maybe_unused]] reference push_back ( const_reference v_ ) { return emplace_back ( v_ ); }
+
+    // Appends [ p_, p_ + n_ ), published at once.
+    void append ( const_pointer const p_, size_type const n_ ) {
+        size_type const s = size ( );
+        if ( HEDLEY_UNLIKELY ( n_ > Capacity - s ) )
+            throw std::bad_alloc ( );
+        grow_to ( s + n_ );
+        std::memcpy ( data ( ) + s, p_, n_ * sizeof ( value_type ) );
+        publish ( s + n_ );
+    }
+
+    // Drops the elements past n_ (the pages stay committed).
+    void truncate ( size_type const n_ ) { publish ( std::min ( n_, size ( ) ) ); }
+    void clear ( ) { truncate ( 0u ); }
+
+    private:
+    using base::hdr;
+    using base::m_section;
+    using base::m_view;
+
+    void commit_b ( std::size_t const b_ ) {
+        std::size_t const c = hdr ( ).committed_b.load ( std::memory_order_relaxed );
+        if ( b_ <= c )
+            return;
+        if ( HEDLEY_UNLIKELY ( not VirtualAlloc ( m_view + base::header_b + c, b_ - c, MEM_COMMIT, PAGE_READWRITE ) ) )
+            throw std::bad_alloc ( );
+        hdr ( ).committed_b.store ( b_, std::memory_order_release );
+    }
+
+    void grow_to ( size_type const n_ ) {
+        std::size_t const need = base::required_b ( n_ );
+        std::size_t c          = hdr ( ).committed_b.load ( std::memory_order_relaxed );
+        if ( HEDLEY_LIKELY ( need <= c ) )
+            return;
+        if ( not c )
+            c = base::page_size_b;
+        while ( c < need )
+            c = static_cast<std::size_t> ( GrowthPolicy::grow ( static_cast<size_type> ( c ) ) );
+        commit_b ( std::min ( base::round_up ( c ), base::capacity_b ( ) ) );
+    }
+
+    void publish ( size_type const n_ ) noexcept {
+        hdr ( ).size.store ( static_cast<std::uint64_t> ( n_ ), std::memory_order_release );
+    }
+};
+
+// A consumer, opens the section of a vm_shared_vector by name and reads it, the access is const only.
+template<typename ValueType, typename SizeType, SizeType Capacity>
+struct vm_shared_vector_reader : detail::shared_vector_base<ValueType, SizeType, Capacity> {
+
+    using base = detail::shared_vector_base<ValueType, SizeType, Capacity>;
+
+    using typename base::value_type;
+
+    // Opens the existing section name_ and maps it, for reading. Throws shared_vector_not_ready if the
+    // producer has not initialized it yet (retry later).
+    explicit vm_shared_vector_reader ( wchar_t const * const name_ ) {
+        m_section.reset ( OpenFileMapping ( FILE_MAP_READ, FALSE, name_ ) );
+        if ( HEDLEY_UNLIKELY ( not m_section ) )
+            throw std::runtime_error ( "OpenFileMapping error: " + sax::win::last_error ( ) );
+        base::map ( FILE_MAP_READ );
+        // The section exists before the producer commits its header page, reading it uncommitted faults.
+        MEMORY_BASIC_INFORMATION mbi;
+        if ( HEDLEY_UNLIKELY ( not VirtualQuery ( m_view, &mbi, sizeof ( mbi ) ) ) )
+            throw std::runtime_error ( "VirtualQuery error: " + sax::win::last_error ( ) );
+        auto const & h = base::hdr ( );
+        if ( HEDLEY_UNLIKELY ( mbi.State != MEM_COMMIT or
+                               h.magic.load ( std::memory_order_acquire ) != base::header::magic_value ) )
+            throw shared_vector_not_ready ( );
+        if ( HEDLEY_UNLIKELY ( h.value_size != sizeof ( value_type ) or h.capacity != static_cast<std::uint64_t> ( Capacity ) ) )
+            throw std::runtime_error ( "vm_shared_vector: the section does not hold a vector of this type" );
+    }
+
+    private:
+    using base::m_section;
+    using base::m_view;
+};
+
+} // namespace sax
@@ -0,0 +1,824 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <numeric>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined( _MSC_VER )
+#    include <intrin.h>
+#else
+#    include <cpuid.h>
+#endif
+#include <immintrin.h>
+
+#include <hedley.hpp>
+
+#include "bit_ops.hpp"
+
+// Scan and reduce kernels (sum, min, max, argmin, argmax, find, count, histogram) over contiguous ranges of
+// std::int32_t, float and double, with AVX2 and AVX-512 versions selected at run-time and a scalar fallback
+// (also used for all other arithmetic types). The kernels take a pointer and a size, the overloads taking a
+// container forward its data ( ) and size ( ), the overloads taking sax::simd::par split the range over the
+// available cores.
+
+namespace sax::simd {
+
+// CPU features.
+
+enum class isa : int { scalar = 0, avx2 = 1, avx512 = 2 };
+
+struct cpu_features {
+    bool avx2 = false, bmi2 = false, avx512f = false, avx512bw = false, avx512vpopcntdq = false;
+};
+
+[[nodiscard]] inline cpu_features detect_cpu_features ( ) noexcept {
+    unsigned r[ 4 ]{ };
+    auto cpuid = [ &r ] ( unsigned leaf_, unsigned sub_leaf_ ) noexcept {
+#if defined( _MSC_VER )
+        __cpuidex ( reinterpret_cast<int *> ( r ), static_cast<int> ( leaf_ ), static_cast<int> ( sub_leaf_ ) );
+#else
+        __cpuid_count ( leaf_, sub_leaf_, r[ 0 ], r[ 1 ], r[ 2 ], r[ 3 ] );
+#endif
+    };
+    auto xgetbv = [] ( ) noexcept -> std::uint64_t {
+#if defined( _MSC_VER )
+        return _xgetbv ( 0 );
+#else
+        std::uint32_t lo, hi;
+        __asm__( "xgetbv" : "=a"( lo ), "=d"( hi ) : "c"( 0 ) );
+        return ( static_cast<std::uint64_t> ( hi ) << 32 ) | lo;
+#endif
+    };
+    cpu_features f;
+    cpuid ( 0u, 0u );
+    if ( r[ 0 ] < 7u )
+        return f;
+    cpuid ( 1u, 0u );
+    if ( not( r[ 2 ] & ( 1u << 27 ) ) ) // OSXSAVE.
+        return f;
+    std::uint64_t const xcr0 = xgetbv ( );
+    bool const os_avx        = ( xcr0 & 0x06u ) == 0x06u; // XMM and YMM state.
+    bool const os_avx512     = ( xcr0 & 0xE6u ) == 0xE6u; // And opmask, ZMM_Hi256 and Hi16_ZMM state.
+    cpuid ( 7u, 0u );
+    f.avx2            = os_avx and ( r[ 1 ] & ( 1u << 5 ) );
+    f.bmi2            = r[ 1 ] & ( 1u << 8 );
+    f.avx512f         = os_avx512 and ( r[ 1 ] & ( 1u << 16 ) );
+    f.avx512bw        = f.avx512f and ( r[ 1 ] & ( 1u << 30 ) );
+    f.avx512vpopcntdq = f.avx512f and ( r[ 2 ] & ( 1u << 14 ) );
+    return f;
+}
+
+inline cpu_features const cpu = detect_cpu_features ( );
+
+[[nodiscard]] inline isa detect_isa ( ) noexcept { return cpu.avx512f ? isa::avx512 : cpu.avx2 ? isa::avx2 : isa::scalar; }
+
+// Kernel selection, can be lowered (f.e. to compare instruction sets), but not above what the cpu supports.
+inline isa cpu_isa = detect_isa ( );
+
+// Processing granularity, a 64KB page.
+inline constexpr std::size_t chunk_b = 65'536u;
+
+// Predicates.
+
+enum class cmp : int { eq, ne, lt, le, gt, ge };
+
+template<cmp Op, typename T>
+[[nodiscard]] constexpr bool compare_scalar ( T const & a_, T const & b_ ) noexcept {
+    if constexpr ( Op == cmp::eq )
+        return a_ == b_;
+    else if constexpr ( Op == cmp::ne )
+        return a_ != b_;
+    else if constexpr ( Op == cmp::lt )
+        return a_ < b_;
+    else if constexpr ( Op == cmp::le )
+        return a_ <= b_;
+    else if constexpr ( Op == cmp::gt )
+        return a_ > b_;
+    else
+        return a_ >= b_;
+}
+
+// Element op value, f.e. count_if ( v, sax::simd::less ( 42 ) ).
+template<typename T>
+struct predicate {
+    cmp op;
+    T value;
+};
+
+template<typename T>
+[[nodiscard]] constexpr predicate<T> equal_to ( T const & v_ ) noexcept {
+    return { cmp::eq, v_ };
+}
+template<typename T>
+[[nodiscard]] constexpr predicate<T> not_equal_to ( T const & v_ ) noexcept {
+    return { cmp::ne, v_ };
+}
+template<typename T>
+[[nodiscard]] constexpr predicate<T> less ( T const & v_ ) noexcept {
+    return { cmp::lt, v_ };
+}
+template<typename T>
+[[nodiscard]] constexpr predicate<T> less_equal ( T const & v_ ) noexcept {
+    return { cmp::le, v_ };
+}
+template<typename T>
+[[nodiscard]] constexpr predicate<T> greater ( T const & v_ ) noexcept {
+    return { cmp::gt, v_ };
+}
+template<typename T>
+[[nodiscard]] constexpr predicate<T> greater_equal ( T const & v_ ) noexcept {
+    return { cmp::ge, v_ };
+}
+
+// The _CMP_* predicate of _mm256_cmp_ps/pd and _mm512_cmp_ps/pd_mask, ordered and non-signaling.
+template<cmp Op>
+inline constexpr int cmp_predicate_v = Op == cmp::eq   ? _CMP_EQ_OQ
+                                       : Op == cmp::ne ? _CMP_NEQ_UQ
+                                       : Op == cmp::lt ? _CMP_LT_OQ
+                                       : Op == cmp::le ? _CMP_LE_OQ
+                                       : Op == cmp::gt ? _CMP_GT_OQ
+                                                       : _CMP_GE_OQ;
+
+template<typename T>
+using sum_type = std::conditional_t<std::is_floating_point<T>::value, double,
+                                    std::conditional_t<std::is_signed<T>::value, std::int64_t, std::uint64_t>>;
+
+template<typename T>
+inline constexpr bool is_vectorized =
+    std::is_same<T, std::int32_t>::value or std::is_same<T, float>::value or std::is_same<T, double>::value;
+
+// Scalar.
+
+namespace scalar {
+
+template<typename T>
+struct traits {
+    using value_type = T;
+    using vec        = T;
+    using sum_type   = simd::sum_type<T>;
+    using acc        = sum_type;
+
+    static constexpr std::size_t width = 1u;
+
+    [[nodiscard]] static vec load ( T const * p_ ) noexcept { return *p_; }
+    static void store ( T * p_, vec const v_ ) noexcept { *p_ = v_; }
+    [[nodiscard]] static vec set1 ( T const v_ ) noexcept { return v_; }
+    [[nodiscard]] static vec min ( vec const a_, vec const b_ ) noexcept { return b_ < a_ ? b_ : a_; }
+    [[nodiscard]] static vec max ( vec const a_, vec const b_ ) noexcept { return a_ < b_ ? b_ : a_; }
+
+    [[nodiscard]] static acc acc_zero ( ) noexcept { return acc{ }; }
+    static void accumulate ( acc & a_, vec const v_ ) noexcept { a_ += v_; }
+    [[nodiscard]] static sum_type reduce_add ( acc const a_ ) noexcept { return a_; }
+
+    template<cmp Op>
+    [[nodiscard]] static std::uint64_t compare ( vec const a_, vec const b_ ) noexcept {
+        return compare_scalar<Op> ( a_, b_ );
+    }
+};
+
+#include "vm_simd_kernels.hpp"
+
+} // namespace scalar
+
+// AVX2.
+
+#if defined( __clang__ )
+#    pragma clang attribute push( __attribute__( ( target( "avx2,bmi,bmi2,popcnt,lzcnt" ) ) ), apply_to = function )
+#elif defined( __GNUC__ )
+#    pragma GCC push_options
+#    pragma GCC target( "avx2,bmi,bmi2,popcnt,lzcnt" )
+#endif
+
+namespace avx2 {
+
+template<typename T>
+struct traits;
+
+template<>
+struct traits<std::int32_t> {
+    using value_type = std::int32_t;
+    using vec        = __m256i;
+    using sum_type   = std::int64_t;
+    struct acc {
+        __m256i lo, hi;
+    };
+
+    static constexpr std::size_t width = 8u;
+
+    [[nodiscard]] static vec load ( value_type const * p_ ) noexcept {
+        return _mm256_loadu_si256 ( reinterpret_cast<__m256i const *> ( p_ ) );
+    }
+    static void store ( value_type * p_, vec const v_ ) noexcept { _mm256_storeu_si256 ( reinterpret_cast<__m256i *> ( p_ ), v_ ); }
+    [[nodiscard]] static vec set1 ( value_type const v_ ) noexcept { return _mm256_set1_epi32 ( v_ ); }
+    [[nodiscard]] static vec min ( vec const a_, vec const b_ ) noexcept { return _mm256_min_epi32 ( a_, b_ ); }
+    [[nodiscard]] static vec max ( vec const a_, vec const b_ ) noexcept { return _mm256_max_epi32 ( a_, b_ ); }
+
+    [[nodiscard]] static acc acc_zero ( ) noexcept { return { _mm256_setzero_si256 ( ), _mm256_setzero_si256 ( ) }; }
+    static void accumulate ( acc & a_, vec const v_ ) noexcept {
+        a_.lo = _mm256_add_epi64 ( a_.lo, _mm256_cvtepi32_epi64 ( _mm256_castsi256_si128 ( v_ ) ) );
+        a_.hi = _mm256_add_epi64 ( a_.hi, _mm256_cvtepi32_epi64 ( _mm256_extracti128_si256 ( v_, 1 ) ) );
+    }
+    [[nodiscard]] static sum_type reduce_add ( acc const a_ ) noexcept {
+        alignas ( 32 ) std::int64_t t[ 4 ];
+        _mm256_store_si256 ( reinterpret_cast<__m256i *> ( t ), _mm256_add_epi64 ( a_.lo, a_.hi ) );
+        return t[ 0 ] + t[ 1 ] + t[ 2 ] + t[ 3 ];
+    }
+
+    template<cmp Op>
+    [[nodiscard]] static std::uint64_t compare ( vec const a_, vec const b_ ) noexcept {
+        if constexpr ( Op == cmp::eq )
+            return bits ( _mm256_cmpeq_epi32 ( a_, b_ ) );
+        else if constexpr ( Op == cmp::ne )
+            return bits ( _mm256_cmpeq_epi32 ( a_, b_ ) ) ^ 0xFFu;
+        else if constexpr ( Op == cmp::lt )
+            return bits ( _mm256_cmpgt_epi32 ( b_, a_ ) );
+        else if constexpr ( Op == cmp::le )
+            return bits ( _mm256_cmpgt_epi32 ( a_, b_ ) ) ^ 0xFFu;
+        else if constexpr ( Op == cmp::gt )
+            return bits ( _mm256_cmpgt_epi32 ( a_, b_ ) );
+        else
+            return bits ( _mm256_cmpgt_epi32 ( b_, a_ ) ) ^ 0xFFu;
+    }
+
+    private:
+    [[nodiscard]] static std::uint64_t bits ( __m256i const m_ ) noexcept {
+        return static_cast<std::uint32_t> ( _mm256_movemask_ps ( _mm256_castsi256_ps ( m_ ) ) );
+    }
+};
+
+template<>
+struct traits<float> {
+    using value_type = float;
+    using vec        = __m256;
+    using sum_type   = double;
+    struct acc {
+        __m256d lo, hi;
+    };
+
+    static constexpr std::size_t width = 8u;
+
+    [[nodiscard]] static vec load ( value_type const * p_ ) noexcept { return _mm256_loadu_ps ( p_ ); }
+    static void store ( value_type * p_, vec const v_ ) noexcept { _mm256_storeu_ps ( p_, v_ ); }
+    [[nodiscard]] static vec set1 ( value_type const v_ ) noexcept { return _mm256_set1_ps ( v_ ); }
+    [[nodiscard]] static vec min ( vec const a_, vec const b_ ) noexcept { return _mm256_min_ps ( a_, b_ ); }
+    [[nodiscard]] static vec max ( vec const a_, vec const b_ ) noexcept { return _mm256_max_ps ( a_, b_ ); }
+
+    [[nodiscard]] static acc acc_zero ( ) noexcept { return { _mm256_setzero_pd ( ), _mm256_setzero_pd ( ) }; }
+    static void accumulate ( acc & a_, vec const v_ ) noexcept {
+        a_.lo = _mm256_add_pd ( a_.lo, _mm256_cvtps_pd ( _mm256_castps256_ps128 ( v_ ) ) );
+        a_.hi = _mm256_add_pd ( a_.hi, _mm256_cvtps_pd ( _mm256_extractf128_ps ( v_, 1 ) ) );
+    }
+    [[nodiscard]] static sum_type reduce_add ( acc const a_ ) noexcept {
+        alignas ( 32 ) double t[ 4 ];
+        _mm256_store_pd ( t, _mm256_add_pd ( a_.lo, a_.hi ) );
+        return ( t[ 0 ] + t[ 1 ] ) + ( t[ 2 ] + t[ 3 ] );
+    }
+
+    template<cmp Op>
+    [[nodiscard]] static std::uint64_t compare ( vec const a_, vec const b_ ) noexcept {
+        return static_cast<std::uint32_t> ( _mm256_movemask_ps ( _mm256_cmp_ps ( a_, b_, cmp_predicate_v<Op> ) ) );
+    }
+};
+
+template<>
+struct traits<double> {
+    using value_type = double;
+    using vec        = __m256d;
+    using sum_type   = double;
+    using acc        = __m256d;
+
+    static constexpr std::size_t width = 4u;
+
+    [[nodiscard]] static vec load ( value_type const * p_ ) noexcept { return _mm256_loadu_pd ( p_ ); }
+    static void store ( value_type * p_, vec const v_ ) noexcept { _mm256_storeu_pd ( p_, v_ ); }
+    [[nodiscard]] static vec set1 ( value_type const v_ ) noexcept { return _mm256_set1_pd ( v_ ); }
+    [[nodiscard]] static vec min ( vec const a_, vec const b_ ) noexcept { return _mm256_min_pd ( a_, b_ ); }
+    [[nodiscard]] static vec max ( vec const a_, vec const b_ ) noexcept { return _mm256_max_pd ( a_, b_ ); }
+
+    [[nodiscard]] static acc acc_zero ( ) noexcept { return _mm256_setzero_pd ( ); }
+    static void accumulate ( acc & a_, vec const v_ ) noexcept { a_ = _mm256_add_pd ( a_, v_ ); }
+    [[nodiscard]] static sum_type reduce_add ( acc const a_ ) noexcept {
+        alignas ( 32 ) double t[ 4 ];
+        _mm256_store_pd ( t, a_ );
+        return ( t[ 0 ] + t[ 1 ] ) + ( t[ 2 ] + t[ 3 ] );
+    }
+
+    template<cmp Op>
+    [[nodiscard]] static std::uint64_t compare ( vec const a_, vec const b_ ) noexcept {
+        return static_cast<std::uint32_t> ( _mm256_movemask_pd ( _mm256_cmp_pd ( a_, b_, cmp_predicate_v<Op> ) ) );
+    }
+};
+
+#include "vm_simd_kernels.hpp"
+
+} // namespace avx2
+
+#if defined( __clang__ )
+#    pragma clang attribute pop
+#elif defined( __GNUC__ )
+#    pragma GCC pop_options
+#endif
+
+// AVX-512 (F).
+
+#if defined( __clang__ )
+#    pragma clang attribute push( __attribute__( ( target( "avx512f,avx2,bmi,bmi2,popcnt,lzcnt" ) ) ), apply_to = function )
+#elif defined( __GNUC__ )
+#    pragma GCC push_options
+#    pragma GCC target( "avx512f,avx2,bmi,bmi2,popcnt,lzcnt" )
+#endif
+
+namespace avx512 {
+
+template<typename T>
+struct traits;
+
+template<>
+struct traits<std::int32_t> {
+    using value_type = std::int32_t;
+    using vec        = __m512i;
+    using sum_type   = std::int64_t;
+    struct acc {
+        __m512i lo, hi;
+    };
+
+    static constexpr std::size_t width = 16u;
+
+    [[nodiscard]] static vec load ( value_type const * p_ ) noexcept { return _mm512_loadu_si512 ( p_ ); }
+    static void store ( value_type * p_, vec const v_ ) noexcept { _mm512_storeu_si512 ( p_, v_ ); }
+    [[nodiscard]] static vec set1 ( value_type const v_ ) noexcept { return _mm512_set1_epi32 ( v_ ); }
+    [[nodiscard]] static vec min ( vec const a_, vec const b_ ) noexcept { return _mm512_min_epi32 ( a_, b_ ); }
+    [[nodiscard]] static vec max ( vec const a_, vec const b_ ) noexcept { return _mm512_max_epi32 ( a_, b_ ); }
+
+    [[nodiscard]] static acc acc_zero ( ) noexcept { return { _mm512_setzero_si512 ( ), _mm512_setzero_si512 ( ) }; }
+    static void accumulate ( acc & a_, vec const v_ ) noexcept {
+        a_.lo = _mm512_add_epi64 ( a_.lo, _mm512_cvtepi32_epi64 ( _mm512_castsi512_si256 ( v_ ) ) );
+        a_.hi = _mm512_add_epi64 ( a_.hi, _mm512_cvtepi32_epi64 ( _mm512_extracti64x4_epi64 ( v_, 1 ) ) );
+    }
+    [[nodiscard]] static sum_type reduce_add ( acc const a_ ) noexcept {
+        return _mm512_reduce_add_epi64 ( _mm512_add_epi64 ( a_.lo, a_.hi ) );
+    }
+
+    template<cmp Op>
+    [[nodiscard]] static std::uint64_t compare ( vec const a_, vec const b_ ) noexcept {
+        constexpr int p = Op == cmp::eq   ? _MM_CMPINT_EQ
+                          : Op == cmp::ne ? _MM_CMPINT_NE
+                          : Op == cmp::lt ? _MM_CMPINT_LT
+                          : Op == cmp::le ? _MM_CMPINT_LE
+                          : Op == cmp::gt ? _MM_CMPINT_NLE
+                                          : _MM_CMPINT_NLT;
+        return _mm512_cmp_epi32_mask ( a_, b_, p );
+    }
+};
+
+template<>
+struct traits<float> {
+    using value_type = float;
+    using vec        = __m512;
+    using sum_type   = double;
+    struct acc {
+        __m512d lo, hi;
+    };
+
+    static constexpr std::size_t width = 16u;
+
+    [[nodiscard]] static vec load ( value_type const * p_ ) noexcept { return _mm512_loadu_ps ( p_ ); }
+    static void store ( value_type * p_, vec const v_ ) noexcept { _mm512_storeu_ps ( p_, v_ ); }
+    [[nodiscard]] static vec set1 ( value_type const v_ ) noexcept { return _mm512_set1_ps ( v_ ); }
+    [[nodiscard]] static vec min ( vec const a_, vec const b_ ) noexcept { return _mm512_min_ps ( a_, b_ ); }
+    [[nodiscard]] static vec max ( vec const a_, vec const b_ ) noexcept { return _mm512_max_ps ( a_, b_ ); }
+
+    [[nodiscard]] static acc acc_zero ( ) noexcept { return { _mm512_setzero_pd ( ), _mm512_setzero_pd ( ) }; }
+    static void accumulate ( acc & a_, vec const v_ ) noexcept {
+        a_.lo = _mm512_add_pd ( a_.lo, _mm512_cvtps_pd ( _mm512_castps512_ps256 ( v_ ) ) );
+        a_.hi =
+            _mm512_add_pd ( a_.hi, _mm512_cvtps_pd ( _mm256_castpd_ps ( _mm512_extractf64x4_pd ( _mm512_castps_pd ( v_ ), 1 ) ) ) );
+    }
+    [[nodiscard]] static sum_type reduce_add ( acc const a_ ) noexcept {
+        return _mm512_reduce_add_pd ( _mm512_add_pd ( a_.lo, a_.hi ) );
+    }
+
+    template<cmp Op>
+    [[nodiscard]] static std::uint64_t compare ( vec const a_, vec const b_ ) noexcept {
+        return _mm512_cmp_ps_mask ( a_, b_, cmp_predicate_v<Op> );
+    }
+};
+
+template<>
+struct traits<double> {
+    using value_type = double;
+    using vec        = __m512d;
+    using sum_type   = double;
+    using acc        = __m512d;
+
+    static constexpr std::size_t width = 8u;
+
+    [[nodiscard]] static vec load ( value_type const * p_ ) noexcept { return _mm512_loadu_pd ( p_ ); }
+    static void store ( value_type * p_, vec const v_ ) noexcept { _mm512_storeu_pd ( p_, v_ ); }
+    [[nodiscard]] static vec set1 ( value_type const v_ ) noexcept { return _mm512_set1_pd ( v_ ); }
+    [[nodiscard]] static vec min ( vec const a_, vec const b_ ) noexcept { return _mm512_min_pd ( a_, b_ ); }
+    [[nodiscard]] static vec max ( vec const a_, vec const b_ ) noexcept { return _mm512_max_pd ( a_, b_ ); }
+
+    [[nodiscard]] static acc acc_zero ( ) noexcept { return _mm512_setzero_pd ( ); }
+    static void accumulate ( acc & a_, vec const v_ ) noexcept { a_ = _mm512_add_pd ( a_, v_ ); }
+    [[nodiscard]] static sum_type reduce_add ( acc const a_ ) noexcept { return _mm512_reduce_add_pd ( a_ ); }
+
+    template<cmp Op>
+    [[nodiscard]] static std::uint64_t compare ( vec const a_, vec const b_ ) noexcept {
+        return _mm512_cmp_pd_mask ( a_, b_, cmp_predicate_v<Op> );
+    }
+};
+
+#include "vm_simd_kernels.hpp"
+
+} // namespace avx512
+
+#if defined( __clang__ )
+#    pragma clang attribute pop
+#elif defined( __GNUC__ )
+#    pragma GCC pop_options
+#endif
+
+// Dispatch.
+
+#define SAX_SIMD_DISPATCH( T, CALL )                                                                                               \
+    do {                                                                                                                           \
+        if constexpr ( is_vectorized<T> ) {                                                                                        \
+            switch ( cpu_isa ) {                                                                                                   \
+                case isa::avx512: return avx512::CALL;                                                                             \
+                case isa::avx2: return avx2::CALL;                                                                                 \
+                default: break;                                                                                                    \
+            }                                                                                                                      \
+        }                                                                                                                          \
+        return scalar::CALL;                                                                                                       \
+    } while ( false )
+
+#define SAX_SIMD_DISPATCH_CMP( T, OP, NAME, ARGS )                                                                                 \
+    do {                                                                                                                           \
+        switch ( OP ) {                                                                                                            \
+            case cmp::eq: SAX_SIMD_DISPATCH ( T, NAME<cmp::eq> ARGS );                                                             \
+            case cmp::ne: SAX_SIMD_DISPATCH ( T, NAME<cmp::ne> ARGS );                                                             \
+            case cmp::lt: SAX_SIMD_DISPATCH ( T, NAME<cmp::lt> ARGS );                                                             \
+            case cmp::le: SAX_SIMD_DISPATCH ( T, NAME<cmp::le> ARGS );                                                             \
+            case cmp::gt: SAX_SIMD_DISPATCH ( T, NAME<cmp::gt> ARGS );                                                             \
+            default: SAX_SIMD_DISPATCH ( T, NAME<cmp::ge> ARGS );                                                                  \
+        }                                                                                                                          \
+    } while ( false )
+
+template<typename T>
+[[nodiscard]] sum_type<T> sum ( T const * p_, std::size_t const n_ ) noexcept {
+    SAX_SIMD_DISPATCH ( T, sum ( p_, n_ ) );
+}
+
+// Requires n_ > 0.
+template<typename T>
+[[nodiscard]] T min ( T const * p_, std::size_t const n_ ) noexcept {
+    SAX_SIMD_DISPATCH ( T, min ( p_, n_ ) );
+}
+// Requires n_ > 0.
+template<typename T>
+[[nodiscard]] T max ( T const * p_, std::size_t const n_ ) noexcept {
+    SAX_SIMD_DISPATCH ( T, max ( p_, n_ ) );
+}
+
+// Index of the (first) minimum, n_ if empty.
+template<typename T>
+[[nodiscard]] std::size_t argmin ( T const * p_, std::size_t const n_ ) noexcept {
+    SAX_SIMD_DISPATCH ( T, argmin ( p_, n_ ) );
+}
+// Index of the (first) maximum, n_ if empty.
+template<typename T>
+[[nodiscard]] std::size_t argmax ( T const * p_, std::size_t const n_ ) noexcept {
+    SAX_SIMD_DISPATCH ( T, argmax ( p_, n_ ) );
+}
+
+// Index of the first element satisfying the predicate, n_ if none.
+template<typename T>
+[[nodiscard]] std::size_t find_if ( T const * p_, std::size_t const n_, predicate<T> const & p ) noexcept {
+    T const v = p.value;
+    SAX_SIMD_DISPATCH_CMP ( T, p.op, find_if, ( p_, n_, v ) );
+}
+template<typename T>
+[[nodiscard]] std::size_t find ( T const * p_, std::size_t const n_, T const & v_ ) noexcept {
+    return find_if ( p_, n_, equal_to ( v_ ) );
+}
+
+template<typename T>
+[[nodiscard]] std::size_t count_if ( T const * p_, std::size_t const n_, predicate<T> const & p ) noexcept {
+    T const v = p.value;
+    SAX_SIMD_DISPATCH_CMP ( T, p.op, count_if, ( p_, n_, v ) );
+}
+template<typename T>
+[[nodiscard]] std::size_t count ( T const * p_, std::size_t const n_, T const & v_ ) noexcept {
+    return count_if ( p_, n_, equal_to ( v_ ) );
+}
+
+#undef SAX_SIMD_DISPATCH_CMP
+#undef SAX_SIMD_DISPATCH
+
+// Counts per bin of width ( hi_ - lo_ ) / bins_ over [ lo_, hi_ ), values outside are not counted. The bin
+// index is computed per element, the counts go to 4 interleaved sub-histograms, which breaks up the store to
+// load dependency on runs of equal values.
+template<typename T>
+[[nodiscard]] std::vector<std::uint64_t> histogram ( T const * p_, std::size_t const n_, T const lo_, T const hi_,
+                                                     std::size_t const bins_ ) {
+    assert ( lo_ < hi_ and bins_ );
+    std::vector<std::uint64_t> h ( 4u * bins_, 0u );
+    double const scale = static_cast<double> ( bins_ ) / ( static_cast<double> ( hi_ ) - static_cast<double> ( lo_ ) );
+    auto bin           = [ = ] ( T const v_ ) noexcept -> std::size_t {
+        if ( HEDLEY_UNLIKELY ( not( lo_ <= v_ and v_ < hi_ ) ) )
+            return bins_; // Out of range.
+        return std::min ( static_cast<std::size_t> ( ( static_cast<double> ( v_ ) - static_cast<double> ( lo_ ) ) * scale ),
+                                    bins_ - 1u );
+    };
+    std::uint64_t * const hp = h.data ( );
+    auto inc                 = [ = ] ( std::size_t const s_, std::size_t const b_ ) noexcept {
+        if ( HEDLEY_LIKELY ( b_ != bins_ ) )
+            ++hp[ s_ * bins_ + b_ ];
+    };
+    std::size_t i = 0u;
+    for ( ; i + 4u <= n_; i += 4u ) {
+        inc ( 0u, bin ( p_[ i ] ) );
+        inc ( 1u, bin ( p_[ i + 1u ] ) );
+        inc ( 2u, bin ( p_[ i + 2u ] ) );
+        inc ( 3u, bin ( p_[ i + 3u ] ) );
+    }
+    for ( ; i < n_; ++i )
+        inc ( 0u, bin ( p_[ i ] ) );
+    for ( std::size_t b = 0u; b < bins_; ++b )
+        h[ b ] += h[ bins_ + b ] + h[ 2u * bins_ + b ] + h[ 3u * bins_ + b ];
+    h.resize ( bins_ );
+    return h;
+}
+
+// Parallel execution.
+
+struct parallel_policy {
+    unsigned threads = 0u; // 0 is std::thread::hardware_concurrency ( ).
+};
+
+inline constexpr parallel_policy par{ };
+
+// Splits [ 0, n_ ) in page-aligned slices, runs kernel_ ( first, count ) on each slice in its own thread and
+// folds the results, in slice order, with combine_.
+template<typename T, typename Kernel, typename Combine>
+[[nodiscard]] auto parallel_reduce ( parallel_policy const & p_, std::size_t const n_, Kernel kernel_, Combine combine_ ) {
+    using result_type           = decltype ( kernel_ ( std::size_t{ }, std::size_t{ } ) );
+    constexpr std::size_t chunk = chunk_b / sizeof ( T );
+    std::size_t const chunks    = ( n_ + chunk - 1u ) / chunk;
+    std::size_t const wanted    = p_.threads ? p_.threads : std::thread::hardware_concurrency ( );
+    std::size_t const threads   = std::max<std::size_t> ( std::min ( wanted, chunks ), 1u );
+    if ( threads == 1u )
+        return kernel_ ( std::size_t{ 0u }, n_ );
+    std::size_t const slice = ( ( chunks + threads - 1u ) / threads ) * chunk;
+    std::vector<result_type> results ( threads );
+    auto const run = [ & ] ( std::size_t const t_ ) {
+        std::size_t const first = std::min ( t_ * slice, n_ ), last = std::min ( first + slice, n_ );
+        results[ t_ ] = kernel_ ( first, last - first );
+    };
+    std::vector<std::thread> pool;
+    pool.reserve ( threads - 1u );
+    std::size_t started = 1u;
+    try {
+        for ( ; started < threads; ++started )
+            pool.emplace_back ( run, started );
+    }
+    catch ( std::system_error const & ) {
+        // Out of threads, the slices left run in this one.
+    }
+    try {
+        run ( 0u );
+        for ( std::size_t t = started; t < threads; ++t )
+            run ( t );
+    }
+    catch ( ... ) {
+        for ( std::thread & w : pool )
+            w.join ( );
+        throw;
+    }
+    for ( std::thread & w : pool )
+        w.join ( );
+    result_type r = results[ 0 ];
+    for ( std::size_t t = 1u; t < threads; ++t )
+        r = combine_ ( r, results[ t ], t * slice );
+    return r;
+}
+
+template<typename T>
+[[nodiscard]] sum_type<T> sum ( parallel_policy const & p_, T const * d_, std::size_t const n_ ) {
+    return parallel_reduce<T> (
+        p_, n_, [ d_ ] ( std::size_t f_, std::size_t c_ ) noexcept { return sum ( d_ + f_, c_ ); },
+        [] ( sum_type<T> a_, sum_type<T> b_, std::size_t ) noexcept { return a_ + b_; } );
+}
+
+template<typename T>
+[[nodiscard]] T min ( parallel_policy const & p_, T const * d_, std::size_t const n_ ) {
+    assert ( n_ );
+    return parallel_reduce<T> (
+        p_, n_, [ d_ ] ( std::size_t f_, std::size_t c_ ) noexcept { return c_ ? min ( d_ + f_, c_ ) : d_[ 0 ]; },
+        [] ( T a_, T b_, std::size_t ) noexcept { return b_ < a_ ? b_ : a_; } );
+}
+template<typename T>
+[[nodiscard]] T max ( parallel_policy const & p_, T const * d_, std::size_t const n_ ) {
+    assert ( n_ );
+    return parallel_reduce<T> (
+        p_, n_, [ d_ ] ( std::size_t f_, std::size_t c_ ) noexcept { return c_ ? max ( d_ + f_, c_ ) : d_[ 0 ]; },
+        [] ( T a_, T b_, std::size_t ) noexcept { return a_ < b_ ? b_ : a_; } );
+}
+
+template<typename T>
+[[nodiscard]] std::size_t argmin ( parallel_policy const & p_, T const * d_, std::size_t const n_ ) {
+    using result = std::pair<std::size_t, std::size_t>; // Index, count of the slice.
+    return parallel_reduce<T> (
+               p_, n_,
+               [ d_ ] ( std::size_t f_, std::size_t c_ ) noexcept {
+                   return result{ f_ + argmin ( d_ + f_, c_ ), f_ + c_ };
+               },
+               [ d_ ] ( result a_, result b_, std::size_t ) noexcept {
+                   if ( b_.first == b_.second ) // Empty slice.
+                       return a_;
+                   return a_.first == a_.second or d_[ b_.first ] < d_[ a_.first ] ? b_ : a_;
+               } )
+        .first;
+}
+template<typename T>
+[[nodiscard]] std::size_t argmax ( parallel_policy const & p_, T const * d_, std::size_t const n_ ) {
+    using result = std::pair<std::size_t, std::size_t>;
+    return parallel_reduce<T> (
+               p_, n_,
+               [ d_ ] ( std::size_t f_, std::size_t c_ ) noexcept {
+                   return result{ f_ + argmax ( d_ + f_, c_ ), f_ + c_ };
+               },
+               [ d_ ] ( result a_, result b_, std::size_t ) noexcept {
+                   if ( b_.first == b_.second )
+                       return a_;
+                   return a_.first == a_.second or d_[ a_.first ] < d_[ b_.first ] ? b_ : a_;
+               } )
+        .first;
+}
+
+template<typename T>
+[[nodiscard]] std::size_t find_if ( parallel_policy const & p_, T const * d_, std::size_t const n_, predicate<T> const & p ) {
+    return std::min ( parallel_reduce<T> (
+                          p_, n_,
+                          [ d_, n_, &p ] ( std::size_t f_, std::size_t c_ ) noexcept {
+                              std::size_t const i = find_if ( d_ + f_, c_, p );
+                              return i == c_ ? n_ : f_ + i;
+                          },
+                          [] ( std::size_t a_, std::size_t b_, std::size_t ) noexcept { return std::min ( a_, b_ ); } ),
+                      n_ );
+}
+template<typename T>
+[[nodiscard]] std::size_t find ( parallel_policy const & p_, T const * d_, std::size_t const n_, T const & v_ ) {
+    return find_if ( p_, d_, n_, equal_to ( v_ ) );
+}
+
+template<typename T>
+[[nodiscard]] std::size_t count_if ( parallel_policy const & p_, T const * d_, std::size_t const n_, predicate<T> const & p ) {
+    return parallel_reduce<T> (
+        p_, n_, [ d_, &p ] ( std::size_t f_, std::size_t c_ ) noexcept { return count_if ( d_ + f_, c_, p ); },
+        [] ( std::size_t a_, std::size_t b_, std::size_t ) noexcept { return a_ + b_; } );
+}
+template<typename T>
+[[nodiscard]] std::size_t count ( parallel_policy const & p_, T const * d_, std::size_t const n_, T const & v_ ) {
+    return count_if ( p_, d_, n_, equal_to ( v_ ) );
+}
+
+template<typename T>
+[[nodiscard]] std::vector<std::uint64_t> histogram ( parallel_policy const & p_, T const * d_, std::size_t const n_, T const lo_,
+                                                     T const hi_, std::size_t const bins_ ) {
+    return parallel_reduce<T> (
+        p_, n_, [ = ] ( std::size_t f_, std::size_t c_ ) { return histogram ( d_ + f_, c_, lo_, hi_, bins_ ); },
+        [] ( std::vector<std::uint64_t> a_, std::vector<std::uint64_t> const & b_, std::size_t ) {
+            std::transform ( a_.begin ( ), a_.end ( ), b_.begin ( ), a_.begin ( ), std::plus<std::uint64_t>{ } );
+            return a_;
+        } );
+}
+
+// Containers (vm_vector, vm_array, virtual_vector, std::vector, ...), over [ data ( ), data ( ) + size ( ) ).
+
+template<typename Container>
+using container_value_t = std::remove_cv_t<std::remove_pointer_t<decltype ( std::declval<Container const &> ( ).data ( ) )>>;
+
+template<typename Container>
+[[nodiscard]] auto sum ( Container const & c_ ) noexcept -> sum_type<container_value_t<Container>> {
+    return sum ( c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ) );
+}
+template<typename Container>
+[[nodiscard]] auto sum ( parallel_policy const & p_, Container const & c_ ) -> sum_type<container_value_t<Container>> {
+    return sum ( p_, c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ) );
+}
+
+template<typename Container>
+[[nodiscard]] auto min ( Container const & c_ ) noexcept -> container_value_t<Container> {
+    return min ( c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ) );
+}
+template<typename Container>
+[[nodiscard]] auto min ( parallel_policy const & p_, Container const & c_ ) -> container_value_t<Container> {
+    return min ( p_, c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ) );
+}
+template<typename Container>
+[[nodiscard]] auto max ( Container const & c_ ) noexcept -> container_value_t<Container> {
+    return max ( c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ) );
+}
+template<typename Container>
+[[nodiscard]] auto max ( parallel_policy const & p_, Container const & c_ ) -> container_value_t<Container> {
+    return max ( p_, c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ) );
+}
+
+template<typename Container>
+[[nodiscard]] auto argmin ( Container const & c_ ) noexcept -> decltype ( argmin ( c_.data ( ), std::size_t{ } ) ) {
+    return argmin ( c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ) );
+}
+template<typename Container>
+[[nodiscard]] std::size_t argmin ( parallel_policy const & p_, Container const & c_ ) {
+    return argmin ( p_, c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ) );
+}
+template<typename Container>
+[[nodiscard]] auto argmax ( Container const & c_ ) noexcept -> decltype ( argmax ( c_.data ( ), std::size_t{ } ) ) {
+    return argmax ( c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ) );
+}
+template<typename Container>
+[[nodiscard]] std::size_t argmax ( parallel_policy const & p_, Container const & c_ ) {
+    return argmax ( p_, c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ) );
+}
+
+template<typename Container>
+[[nodiscard]] std::size_t find ( Container const & c_, container_value_t<Container> const & v_ ) noexcept {
+    return find ( c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ), v_ );
+}
+template<typename Container>
+[[nodiscard]] std::size_t find ( parallel_policy const & p_, Container const & c_, container_value_t<Container> const & v_ ) {
+    return find ( p_, c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ), v_ );
+}
+template<typename Container>
+[[nodiscard]] std::size_t find_if ( Container const & c_, predicate<container_value_t<Container>> const & p ) noexcept {
+    return find_if ( c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ), p );
+}
+template<typename Container>
+[[nodiscard]] std::size_t find_if ( parallel_policy const & p_, Container const & c_,
+                                    predicate<container_value_t<Container>> const & p ) {
+    return find_if ( p_, c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ), p );
+}
+
+template<typename Container>
+[[nodiscard]] std::size_t count ( Container const & c_, container_value_t<Container> const & v_ ) noexcept {
+    return count ( c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ), v_ );
+}
+template<typename Container>
+[[nodiscard]] std::size_t count ( parallel_policy const & p_, Container const & c_, container_value_t<Container> const & v_ ) {
+    return count ( p_, c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ), v_ );
+}
+template<typename Container>
+[[nodiscard]] std::size_t count_if ( Container const & c_, predicate<container_value_t<Container>> const & p ) noexcept {
+    return count_if ( c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ), p );
+}
+template<typename Container>
+[[nodiscard]] std::size_t count_if ( parallel_policy const & p_, Container const & c_,
+                                     predicate<container_value_t<Container>> const & p ) {
+    return count_if ( p_, c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ), p );
+}
+
+template<typename Container, typename T = container_value_t<Container>>
+[[nodiscard]] std::vector<std::uint64_t> histogram ( Container const & c_, T const lo_, T const hi_, std::size_t const bins_ ) {
+    return histogram ( c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ), lo_, hi_, bins_ );
+}
+template<typename Container, typename T = container_value_t<Container>>
+[[nodiscard]] std::vector<std::uint64_t> histogram ( parallel_policy const & p_, Container const & c_, T const lo_, T const hi_,
+                                                     std::size_t const bins_ ) {
+    return histogram ( p_, c_.data ( ), static_cast<std::size_t> ( c_.size ( ) ), lo_, hi_, bins_ );
+}
+
+} // namespace sax::simd
@@ -0,0 +1,166 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// No include guard, this file is included by vm_simd.hpp once per instruction set, inside the namespace
+// (sax::simd::scalar, sax::simd::avx2, sax::simd::avx512) that defines traits<T> for that instruction set
+// and with the matching target options in effect.
+//
+// The kernels never read past p_ + n_: the tail is done one element at a time, so a scan that ends at the
+// size of a container does not touch its (possibly uncommitted) remainder.
+
+template<typename T>
+[[nodiscard]] typename traits<T>::sum_type sum ( T const * p_, std::size_t const n_ ) noexcept {
+    using V            = traits<T>;
+    typename V::acc a0 = V::acc_zero ( );
+    typename V::acc a1 = V::acc_zero ( );
+    std::size_t i      = 0u;
+    for ( ; i + 2u * V::width <= n_; i += 2u * V::width ) {
+        V::accumulate ( a0, V::load ( p_ + i ) );
+        V::accumulate ( a1, V::load ( p_ + i + V::width ) );
+    }
+    for ( ; i + V::width <= n_; i += V::width )
+        V::accumulate ( a0, V::load ( p_ + i ) );
+    typename V::sum_type s = V::reduce_add ( a0 ) + V::reduce_add ( a1 );
+    for ( ; i < n_; ++i )
+        s += p_[ i ];
+    return s;
+}
+
+template<typename T>
+[[nodiscard]] T horizontal_min ( typename traits<T>::vec const v_ ) noexcept {
+    T t[ traits<T>::width ];
+    traits<T>::store ( t, v_ );
+    return *std::min_element ( t, t + traits<T>::width );
+}
+template<typename T>
+[[nodiscard]] T horizontal_max ( typename traits<T>::vec const v_ ) noexcept {
+    T t[ traits<T>::width ];
+    traits<T>::store ( t, v_ );
+    return *std::max_element ( t, t + traits<T>::width );
+}
+
+// Requires n_ > 0.
+template<typename T>
+[[nodiscard]] T min ( T const * p_, std::size_t const n_ ) noexcept {
+    using V = traits<T>;
+    assert ( n_ );
+    std::size_t i = 0u;
+    T r           = p_[ 0 ];
+    if ( n_ >= V::width ) {
+        typename V::vec m = V::load ( p_ );
+        for ( i = V::width; i + V::width <= n_; i += V::width )
+            m = V::min ( m, V::load ( p_ + i ) );
+        r = horizontal_min<T> ( m );
+    }
+    for ( ; i < n_; ++i )
+        r = p_[ i ] < r ? p_[ i ] : r;
+    return r;
+}
+// Requires n_ > 0.
+template<typename T>
+[[nodiscard]] T max ( T const * p_, std::size_t const n_ ) noexcept {
+    using V = traits<T>;
+    assert ( n_ );
+    std::size_t i = 0u;
+    T r           = p_[ 0 ];
+    if ( n_ >= V::width ) {
+        typename V::vec m = V::load ( p_ );
+        for ( i = V::width; i + V::width <= n_; i += V::width )
+            m = V::max ( m, V::load ( p_ + i ) );
+        r = horizontal_max<T> ( m );
+    }
+    for ( ; i < n_; ++i )
+        r = r < p_[ i ] ? p_[ i ] : r;
+    return r;
+}
+
+// Index of the first element for which compare<Op> ( element, v_ ) holds, n_ if none.
+template<cmp Op, typename T>
+[[nodiscard]] std::size_t find_if ( T const * p_, std::size_t const n_, T const v_ ) noexcept {
+    using V                 = traits<T>;
+    typename V::vec const s = V::set1 ( v_ );
+    std::size_t i           = 0u;
+    for ( ; i + V::width <= n_; i += V::width ) {
+        if ( std::uint64_t const m = V::template compare<Op> ( V::load ( p_ + i ), s ); HEDLEY_UNLIKELY ( m ) )
+            return i + static_cast<std::size_t> ( sax::countr_zero ( m ) );
+    }
+    for ( ; i < n_; ++i ) {
+        if ( compare_scalar<Op> ( p_[ i ], v_ ) )
+            return i;
+    }
+    return n_;
+}
+
+// Number of elements for which compare<Op> ( element, v_ ) holds.
+template<cmp Op, typename T>
+[[nodiscard]] std::size_t count_if ( T const * p_, std::size_t const n_, T const v_ ) noexcept {
+    using V                 = traits<T>;
+    typename V::vec const s = V::set1 ( v_ );
+    std::size_t i = 0u, c0 = 0u, c1 = 0u;
+    for ( ; i + 2u * V::width <= n_; i += 2u * V::width ) {
+        c0 += static_cast<std::size_t> ( sax::popcount ( V::template compare<Op> ( V::load ( p_ + i ), s ) ) );
+        c1 += static_cast<std::size_t> ( sax::popcount ( V::template compare<Op> ( V::load ( p_ + i + V::width ), s ) ) );
+    }
+    for ( ; i < n_; ++i )
+        c0 += compare_scalar<Op> ( p_[ i ], v_ );
+    return c0 + c1;
+}
+
+// The minimum (maximum) is taken per chunk, only a chunk that improves on it is scanned a second time (from
+// cache) for the position. A NaN never compares equal, a chunk whose minimum (maximum) comes out as NaN is
+// skipped: with NaNs in the input the result is the position of a number, not necessarily the extreme one, or
+// n_ if there is none.
+template<typename T>
+[[nodiscard]] std::size_t argmin ( T const * p_, std::size_t const n_ ) noexcept {
+    constexpr std::size_t chunk = chunk_b / sizeof ( T );
+    std::size_t r               = n_;
+    T best{ };
+    for ( std::size_t i = 0u; i < n_; i += chunk ) {
+        std::size_t const c = std::min ( chunk, n_ - i );
+        T const m           = min ( p_ + i, c );
+        if ( r == n_ or m < best ) {
+            if ( std::size_t const f = find_if<cmp::eq> ( p_ + i, c, m ); HEDLEY_LIKELY ( f != c ) ) {
+                best = m;
+                r    = i + f;
+            }
+        }
+    }
+    return r;
+}
+template<typename T>
+[[nodiscard]] std::size_t argmax ( T const * p_, std::size_t const n_ ) noexcept {
+    constexpr std::size_t chunk = chunk_b / sizeof ( T );
+    std::size_t r               = n_;
+    T best{ };
+    for ( std::size_t i = 0u; i < n_; i += chunk ) {
+        std::size_t const c = std::min ( chunk, n_ - i );
+        T const m           = max ( p_ + i, c );
+        if ( r == n_ or best < m ) {
+            if ( std::size_t const f = find_if<cmp::eq> ( p_ + i, c, m ); HEDLEY_LIKELY ( f != c ) ) {
+                best = m;
+                r    = i + f;
+            }
+        }
+    }
+    return r;
+}
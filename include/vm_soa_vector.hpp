@@ -0,0 +1,414 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef NOMINMAX
+#    define NOMINMAX
+#endif
+
+#include <Memoryapi.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <boost/pfr/precise.hpp>
+
+#include <hedley.hpp>
+
+#include "growth_policy.hpp"
+
+namespace sax {
+
+// Iterates a set of equally sized columns in lockstep, dereferencing to a tuple of references.
+template<typename... Ts>
+struct zip_iterator {
+
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type        = std::tuple<Ts...>;
+    using difference_type   = std::ptrdiff_t;
+    using reference         = std::tuple<Ts &...>;
+    using pointer           = void;
+
+    zip_iterator ( ) noexcept = default;
+    explicit zip_iterator ( std::tuple<Ts *...> const & p_ ) noexcept : m_p{ p_ } {}
+
+    [[nodiscard]] reference operator* ( ) const noexcept {
+        return std::apply ( [] ( Ts *... p_ ) noexcept { return reference{ *p_... }; }, m_p );
+    }
+    [[nodiscard]] reference operator[] ( difference_type const i_ ) const noexcept { return *( *this + i_ ); }
+
+    [[maybe_unused]] zip_iterator & operator+= ( difference_type const i_ ) noexcept {
+        std::apply ( [ i_ ] ( Ts *&... p_ ) noexcept { ( ( p_ += i_ ), ... ); }, m_p );
+        return *this;
+    }
+    [[maybe_unused]] zip_iterator & operator-= ( difference_type const i_ ) noexcept { return *this += -i_; }
+    [[maybe_unused]] zip_iterator & operator++ ( ) noexcept { return *this += 1; }
+    [[maybe_unused]] zip_iterator & operator-- ( ) noexcept { return *this -= 1; }
+    [[maybe_unused]] zip_iterator operator++ ( int ) noexcept {
+        zip_iterator tmp{ *this };
+        ++*this;
+        return tmp;
+    }
+    [[maybe_unused]] zip_iterator operator-- ( int ) noexcept {
+        zip_iterator tmp{ *this };
+        --*this;
+        return tmp;
+    }
+
+    [[nodiscard]] friend zip_iterator operator+ ( zip_iterator it_, difference_type const i_ ) noexcept { return it_ += i_; }
+    [[nodiscard]] friend zip_iterator operator+ ( difference_type const i_, zip_iterator it_ ) noexcept { return it_ += i_; }
+    [[nodiscard]] friend zip_iterator operator- ( zip_iterator it_, difference_type const i_ ) noexcept { return it_ -= i_; }
+    [[nodiscard]] friend difference_type operator- ( zip_iterator const & l_, zip_iterator const & r_ ) noexcept {
+        return std::get<0> ( l_.m_p ) - std::get<0> ( r_.m_p );
+    }
+
+    // All columns move in lockstep, comparing the first one suffices.
+    [[nodiscard]] friend bool operator== ( zip_iterator const & l_, zip_iterator const & r_ ) noexcept {
+        return std::get<0> ( l_.m_p ) == std::get<0> ( r_.m_p );
+    }
+    [[nodiscard]] friend bool operator!= ( zip_iterator const & l_, zip_iterator const & r_ ) noexcept { return not( l_ == r_ ); }
+    [[nodiscard]] friend bool operator< ( zip_iterator const & l_, zip_iterator const & r_ ) noexcept {
+        return std::get<0> ( l_.m_p ) < std::get<0> ( r_.m_p );
+    }
+    [[nodiscard]] friend bool operator> ( zip_iterator const & l_, zip_iterator const & r_ ) noexcept { return r_ < l_; }
+    [[nodiscard]] friend bool operator<= ( zip_iterator const & l_, zip_iterator const & r_ ) noexcept { return not( r_ < l_ ); }
+    [[nodiscard]] friend bool operator>= ( zip_iterator const & l_, zip_iterator const & r_ ) noexcept { return not( l_ < r_ ); }
+
+    private:
+    std::tuple<Ts *...> m_p;
+};
+
+template<typename... Ts>
+struct zip_range {
+    using iterator = zip_iterator<Ts...>;
+
+    [[nodiscard]] iterator begin ( ) const noexcept { return m_begin; }
+    [[nodiscard]] iterator end ( ) const noexcept { return m_end; }
+    [[nodiscard]] std::size_t size ( ) const noexcept { return static_cast<std::size_t> ( m_end - m_begin ); }
+
+    iterator m_begin, m_end;
+};
+
+// A column, the elements [ begin, end ) of one field.
+template<typename T>
+struct column_range {
+    using value_type = std::remove_const_t<T>;
+    using iterator   = T *;
+
+    [[nodiscard]] iterator begin ( ) const noexcept { return m_begin; }
+    [[nodiscard]] iterator end ( ) const noexcept { return m_end; }
+    [[nodiscard]] T * data ( ) const noexcept { return m_begin; }
+    [[nodiscard]] std::size_t size ( ) const noexcept { return static_cast<std::size_t> ( m_end - m_begin ); }
+    [[nodiscard]] bool empty ( ) const noexcept { return m_begin == m_end; }
+    [[nodiscard]] T & operator[] ( std::size_t const i_ ) const noexcept {
+        assert ( i_ < size ( ) );
+        return m_begin[ i_ ];
+    }
+
+    T *m_begin, *m_end;
+};
+
+// Structure-of-arrays vector of an aggregate: every field (as reflected by boost::pfr) lives in its own
+// reserved column, the columns are committed in lockstep. Row access goes through tuples of references.
+
+template<typename Aggregate, typename SizeType, SizeType Capacity,
+         typename GrowthPolicy = linear_growth_policy<SizeType, static_cast<SizeType> ( 1'600 * 65'536 )>>
+struct vm_soa_vector {
+
+    static_assert ( std::is_aggregate<Aggregate>::value, "vm_soa_vector requires an aggregate" );
+
+    static constexpr std::size_t field_count = boost::pfr::tuple_size_v<Aggregate>;
+
+    template<std::size_t I>
+    using field_type = boost::pfr::tuple_element_t<I, Aggregate>;
+
+    private:
+    template<typename Seq>
+    struct types;
+    template<std::size_t... Is>
+    struct types<std::index_sequence<Is...>> {
+        using reference       = std::tuple<field_type<Is> &...>;
+        using const_reference = std::tuple<field_type<Is> const &...>;
+        using iterator        = zip_iterator<field_type<Is>...>;
+        using const_iterator  = zip_iterator<field_type<Is> const...>;
+    };
+    using fields = std::make_index_sequence<field_count>;
+
+    public:
+    using value_type = Aggregate;
+
+    using reference       = typename types<fields>::reference;
+    using const_reference = typename types<fields>::const_reference;
+
+    using size_type       = SizeType;
+    using difference_type = std::make_signed_t<size_type>;
+
+    using iterator       = typename types<fields>::iterator;
+    using const_iterator = typename types<fields>::const_iterator;
+
+    vm_soa_vector ( ) : m_size{ 0u }, m_committed{ 0u } { reserve_impl ( fields{ } ); }
+
+    vm_soa_vector ( std::initializer_list<value_type> il_ ) : vm_soa_vector{ } {
+        for ( value_type const & v : il_ )
+            push_back ( v );
+    }
+
+    vm_soa_vector ( vm_soa_vector const & )             = delete;
+    vm_soa_vector & operator= ( vm_soa_vector const & ) = delete;
+
+    ~vm_soa_vector ( ) {
+        clear ( );
+        for ( void * c : m_columns ) {
+            if ( HEDLEY_LIKELY ( c ) )
+                VirtualFree ( c, 0u, MEM_RELEASE );
+        }
+        m_columns.fill ( nullptr );
+    }
+
+    [[nodiscard]] static constexpr size_type capacity ( ) noexcept { return Capacity; }
+    [[nodiscard]] size_type size ( ) const noexcept { return m_size; }
+    [[nodiscard]] size_type committed ( ) const noexcept { return m_committed; }
+    [[nodiscard]] static constexpr size_type max_size ( ) noexcept { return capacity ( ); }
+    [[nodiscard]] bool empty ( ) const noexcept { return not m_size; }
+
+    // Add.
+
+    [[maybe_unused]] reference push_back ( value_type const & value_ ) {
+        grow_if_full ( );
+        push_back_impl ( value_, fields{ } );
+        return operator[] ( m_size++ );
+    }
+    [[maybe_unused]] reference push_back ( value_type && value_ ) {
+        grow_if_full ( );
+        push_back_impl ( std::move ( value_ ), fields{ } );
+        return operator[] ( m_size++ );
+    }
+    template<typename... Args>
+    [[maybe_unused]] reference emplace_back ( Args &&... value_ ) {
+        return push_back ( value_type{ std::forward<Args> ( value_ )... } );
+    }
+
+    void pop_back ( ) noexcept {
+        assert ( m_size );
+        --m_size;
+        destroy_impl ( m_size, m_size + 1u, fields{ } );
+    }
+
+    void clear ( ) noexcept {
+        destroy_impl ( 0u, m_size, fields{ } );
+        m_size = 0u;
+    }
+
+    // Columns.
+
+    template<std::size_t I>
+    [[nodiscard]] column_range<field_type<I> const> column ( ) const noexcept {
+        return { column_data<I> ( ), column_data<I> ( ) + m_size };
+    }
+    template<std::size_t I>
+    [[nodiscard]] column_range<field_type<I>> column ( ) noexcept {
+        return { column_data<I> ( ), column_data<I> ( ) + m_size };
+    }
+
+    // Zips a subset of the columns, f.e. zip<0, 2> ( ), only those columns are touched.
+    template<std::size_t... Is>
+    [[nodiscard]] zip_range<field_type<Is> const...> zip ( ) const noexcept {
+        return { zip_iterator<field_type<Is> const...>{ std::tuple<field_type<Is> const *...>{ column_data<Is> ( )... } },
+                 zip_iterator<field_type<Is> const...>{
+                     std::tuple<field_type<Is> const *...>{ column_data<Is> ( ) + m_size... } } };
+    }
+    template<std::size_t... Is>
+    [[nodiscard]] zip_range<field_type<Is>...> zip ( ) noexcept {
+        return { zip_iterator<field_type<Is>...>{ std::tuple<field_type<Is> *...>{ column_data<Is> ( )... } },
+                 zip_iterator<field_type<Is>...>{ std::tuple<field_type<Is> *...>{ column_data<Is> ( ) + m_size... } } };
+    }
+
+    // Iterators, over all columns.
+
+    [[nodiscard]] const_iterator begin ( ) const noexcept { return iterator_impl<const_iterator> ( 0u, fields{ } ); }
+    [[nodiscard]] const_iterator cbegin ( ) const noexcept { return begin ( ); }
+    [[nodiscard]] iterator begin ( ) noexcept { return iterator_impl<iterator> ( 0u, fields{ } ); }
+
+    [[nodiscard]] const_iterator end ( ) const noexcept { return iterator_impl<const_iterator> ( m_size, fields{ } ); }
+    [[nodiscard]] const_iterator cend ( ) const noexcept { return end ( ); }
+    [[nodiscard]] iterator end ( ) noexcept { return iterator_impl<iterator> ( m_size, fields{ } ); }
+
+    // Rows.
+
+    [[nodiscard]] const_reference operator[] ( size_type const i_ ) const noexcept {
+        assert ( i_ < size ( ) );
+        return *iterator_impl<const_iterator> ( i_, fields{ } );
+    }
+    [[nodiscard]] reference operator[] ( size_type const i_ ) noexcept {
+        assert ( i_ < size ( ) );
+        return *iterator_impl<iterator> ( i_, fields{ } );
+    }
+
+    [[nodiscard]] const_reference at ( size_type const i_ ) const {
+        if ( HEDLEY_LIKELY ( i_ < size ( ) ) )
+            return operator[] ( i_ );
+        else
+            throw std::runtime_error ( "vm_soa_vector: index out of bounds" );
+    }
+    [[nodiscard]] reference at ( size_type const i_ ) {
+        if ( HEDLEY_LIKELY ( i_ < size ( ) ) )
+            return operator[] ( i_ );
+        else
+            throw std::runtime_error ( "vm_soa_vector: index out of bounds" );
+    }
+
+    // Gathers row i_ back into an aggregate.
+    [[nodiscard]] value_type get ( size_type const i_ ) const { return get_impl ( i_, fields{ } ); }
+
+    private:
+    static constexpr size_type page_size_b            = static_cast<size_type> ( 65'536 );         // 64KB
+    static constexpr size_type allocation_page_size_b = static_cast<size_type> ( 1'600 * 65'536 ); // 100MB
+
+    template<std::size_t... Is>
+    static constexpr size_type row_size_b ( std::index_sequence<Is...> ) noexcept {
+        return static_cast<size_type> ( ( sizeof ( field_type<Is> ) + ... ) );
+    }
+
+    [[nodiscard]] static constexpr size_type required_b ( std::size_t const s_, size_type const n_ ) noexcept {
+        std::size_t const req = n_ * s_;
+        return static_cast<size_type> ( req % page_size_b ? ( ( req + page_size_b ) / page_size_b ) * page_size_b : req );
+    }
+
+    template<std::size_t I>
+    [[nodiscard]] field_type<I> * column_data ( ) const noexcept {
+        return reinterpret_cast<field_type<I> *> ( m_columns[ I ] );
+    }
+
+    template<typename It, std::size_t... Is>
+    [[nodiscard]] It iterator_impl ( size_type const i_, std::index_sequence<Is...> ) const noexcept {
+        return It{ { column_data<Is> ( ) + i_... } };
+    }
+
+    template<std::size_t... Is>
+    void reserve_impl ( std::index_sequence<Is...> ) {
+        ( ( m_columns[ Is ] =
+                VirtualAlloc ( nullptr, required_b ( sizeof ( field_type<Is> ), Capacity ), MEM_RESERVE, PAGE_READWRITE ) ),
+          ... );
+        if ( HEDLEY_UNLIKELY ( std::any_of ( m_columns.begin ( ), m_columns.end ( ), [] ( void * c ) { return not c; } ) ) ) {
+            for ( void * c : m_columns )
+                if ( c )
+                    VirtualFree ( c, 0u, MEM_RELEASE );
+            throw std::bad_alloc ( );
+        }
+    }
+
+    template<std::size_t... Is>
+    [[nodiscard]] bool commit_impl ( size_type const to_, std::index_sequence<Is...> ) noexcept {
+        return ( ( VirtualAlloc ( m_columns[ Is ], required_b ( sizeof ( field_type<Is> ), to_ ), MEM_COMMIT, PAGE_READWRITE ) !=
+                   nullptr ) and
+                 ... );
+    }
+
+    // All columns grow together, by the growth policy applied to the size of a row.
+    void grow_if_full ( ) {
+        if ( HEDLEY_UNLIKELY ( m_size == m_committed ) ) {
+            if ( HEDLEY_UNLIKELY ( m_committed == Capacity ) )
+                throw std::bad_alloc ( );
+            constexpr size_type row_b = row_size_b ( fields{ } );
+            size_type const cib =
+                m_committed ? GrowthPolicy::grow ( static_cast<size_type> ( m_committed * row_b ) ) : allocation_page_size_b;
+            size_type const c = std::min (
+                std::max ( static_cast<size_type> ( cib / row_b ), static_cast<size_type> ( m_committed + 1u ) ), Capacity );
+            if ( HEDLEY_UNLIKELY ( not commit_impl ( c, fields{ } ) ) )
+                throw std::bad_alloc ( );
+            m_committed = c;
+        }
+    }
+
+    // The fields of the row at m_size are constructed column by column, if one throws the fields of the columns
+    // before it are destroyed.
+    template<std::size_t... Is>
+    void push_back_impl ( value_type const & value_, std::index_sequence<Is...> ) {
+        std::size_t k = 0u; // Fields constructed.
+        try {
+            ( ( new ( column_data<Is> ( ) + m_size ) field_type<Is>{ boost::pfr::get<Is> ( value_ ) }, ++k ), ... );
+        }
+        catch ( ... ) {
+            destroy_fields_impl ( m_size, k, fields{ } );
+            throw;
+        }
+    }
+    template<std::size_t... Is>
+    void push_back_impl ( value_type && value_, std::index_sequence<Is...> ) {
+        std::size_t k = 0u; // Fields constructed.
+        try {
+            ( ( new ( column_data<Is> ( ) + m_size ) field_type<Is>{ std::move ( boost::pfr::get<Is> ( value_ ) ) }, ++k ), ... );
+        }
+        catch ( ... ) {
+            destroy_fields_impl ( m_size, k, fields{ } );
+            throw;
+        }
+    }
+
+    // Destroys the fields of the columns [ 0, n_ ) of row i_.
+    template<std::size_t... Is>
+    void destroy_fields_impl ( size_type const i_, std::size_t const n_, std::index_sequence<Is...> ) noexcept {
+        (
+            [ & ] {
+                if constexpr ( not std::is_trivial<field_type<Is>>::value ) {
+                    if ( Is < n_ )
+                        std::destroy_at ( column_data<Is> ( ) + i_ );
+                }
+            }( ),
+            ... );
+    }
+
+    template<std::size_t... Is>
+    void destroy_impl ( size_type const b_, size_type const e_, std::index_sequence<Is...> ) noexcept {
+        (
+            [ & ] {
+                if constexpr ( not std::is_trivial<field_type<Is>>::value ) {
+                    std::destroy ( column_data<Is> ( ) + b_, column_data<Is> ( ) + e_ );
+                }
+            }( ),
+            ... );
+    }
+
+    template<std::size_t... Is>
+    [[nodiscard]] value_type get_impl ( size_type const i_, std::index_sequence<Is...> ) const {
+        return value_type{ column_data<Is> ( )[ i_ ]... };
+    }
+
+    std::array<void *, field_count> m_columns{ };
+    size_type m_size, m_committed; // In rows.
+};
+
+} // namespace sax
@@ -0,0 +1,406 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef NOMINMAX
+#    define NOMINMAX
+#endif
+
+#include <Memoryapi.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <hedley.hpp>
+
+#include "bit_ops.hpp"
+#include "vm_simd.hpp"
+#include "winsys.hpp"
+
+namespace sax {
+
+// Sparse array over a huge (reserved) index space. A 64KB page is committed when an index in it is first
+// written and, if so constructed, decommitted again when its last entry is erased. A page bitmap tells which
+// pages are committed, an entry bitmap (committed along with the page) which entries are present, iteration
+// only visits the committed pages. The entries of a page never straddle a page boundary.
+
+template<typename ValueType, typename SizeType, SizeType Capacity>
+struct vm_sparse_array {
+
+    static_assert ( std::is_trivially_copyable<ValueType>::value, "vm_sparse_array requires a trivially copyable type" );
+    static_assert ( sizeof ( ValueType ) <= 65'536u, "vm_sparse_array entries must fit in a page" );
+
+    using value_type = ValueType;
+
+    using pointer       = value_type *;
+    using const_pointer = value_type const *;
+
+    using reference       = value_type &;
+    using const_reference = value_type const &;
+
+    using size_type       = SizeType;
+    using difference_type = std::make_signed_t<size_type>;
+
+    static constexpr size_type page_size_b   = static_cast<size_type> ( 65'536 );   // 64KB
+    static constexpr size_type page_capacity = page_size_b / sizeof ( value_type ); // Entries per page.
+    static constexpr size_type page_count    = ( Capacity + page_capacity - 1u ) / page_capacity;
+
+    explicit vm_sparse_array ( bool const decommit_empty_pages_ = true ) : m_decommit_empty{ decommit_empty_pages_ } {
+        try {
+            m_data =
+                reinterpret_cast<char *> ( reserve_impl ( static_cast<std::size_t> ( page_count ) * page_size_b, MEM_RESERVE ) );
+            m_page_bits   = reinterpret_cast<std::uint64_t *> ( reserve_impl ( page_words * 8u, MEM_RESERVE | MEM_COMMIT ) );
+            m_entry_count = reinterpret_cast<std::uint32_t *> ( reserve_impl ( page_count * 4u, MEM_RESERVE ) );
+            m_entry_bits  = reinterpret_cast<std::uint64_t *> ( reserve_impl ( page_count * entry_words * 8u, MEM_RESERVE ) );
+        }
+        catch ( ... ) {
+            release ( );
+            throw;
+        }
+    }
+
+    vm_sparse_array ( vm_sparse_array const & )             = delete;
+    vm_sparse_array & operator= ( vm_sparse_array const & ) = delete;
+
+    ~vm_sparse_array ( ) { release ( ); }
+
+    // Size.
+
+    [[nodiscard]] static constexpr size_type capacity ( ) noexcept { return Capacity; }
+    [[nodiscard]] static constexpr size_type max_size ( ) noexcept { return capacity ( ); }
+    [[nodiscard]] size_type size ( ) const noexcept { return m_size; } // Entries present.
+    [[nodiscard]] bool empty ( ) const noexcept { return not m_size; }
+    [[nodiscard]] size_type committed_pages ( ) const noexcept { return m_committed_pages; }
+
+    // Lookup.
+
+    [[nodiscard]] bool page_committed ( size_type const page_ ) const noexcept {
+        return m_page_bits[ page_ >> 6 ] >> ( page_ & 63u ) & 1u;
+    }
+    [[nodiscard]] bool contains ( size_type const i_ ) const noexcept {
+        assert ( i_ < capacity ( ) );
+        size_type const page = i_ / page_capacity;
+        return page_committed ( page ) and entry_bit ( page, i_ % page_capacity );
+    }
+
+    // Pointer to the entry at i_, nullptr if not present.
+    [[nodiscard]] const_pointer find ( size_type const i_ ) const noexcept { return contains ( i_ ) ? address ( i_ ) : nullptr; }
+    [[nodiscard]] pointer find ( size_type const i_ ) noexcept {
+        return const_cast<pointer> ( std::as_const ( *this ).find ( i_ ) );
+    }
+
+    // The entry at i_, or a value-initialized value_type if not present.
+    [[nodiscard]] value_type get ( size_type const i_ ) const noexcept {
+        const_pointer p = find ( i_ );
+        return p ? *p : value_type{ };
+    }
+
+    [[nodiscard]] const_reference at ( size_type const i_ ) const {
+        if ( const_pointer p = find ( i_ ); HEDLEY_LIKELY ( p ) )
+            return *p;
+        else
+            throw std::runtime_error ( "vm_sparse_array: no entry at index" );
+    }
+    [[nodiscard]] reference at ( size_type const i_ ) { return const_cast<reference> ( std::as_const ( *this ).at ( i_ ) ); }
+
+    // Inserts a value-initialized entry at i_ if not present (like std::map).
+    [[nodiscard]] reference operator[] ( size_type const i_ ) { return *insert_impl ( i_ ).first; }
+
+    // Modify.
+
+    // Sets the entry at i_, returns true if it was not present before.
+    [[maybe_unused]] bool set ( size_type const i_, value_type const & v_ ) {
+        auto [ p, inserted ] = insert_impl ( i_ );
+        *p                   = v_;
+        return inserted;
+    }
+
+    // Removes the entry at i_, returns true if it was present.
+    [[maybe_unused]] bool erase ( size_type const i_ ) noexcept {
+        if ( not contains ( i_ ) )
+            return false;
+        size_type const page = i_ / page_capacity, offset = i_ % page_capacity;
+        m_entry_bits[ page * entry_words + ( offset >> 6 ) ] &= ~( std::uint64_t{ 1u } << ( offset & 63u ) );
+        --m_size;
+        if ( not --m_entry_count[ page ] and m_decommit_empty )
+            decommit_page ( page );
+        return true;
+    }
+
+    // Decommits the committed pages without entries, those left by erase if constructed not to decommit.
+    void shrink_to_fit ( ) noexcept {
+        for ( size_type w = 0u; w < page_words; ++w ) {
+            for ( std::uint64_t b = m_page_bits[ w ]; b; b &= b - 1u ) {
+                size_type const page = static_cast<size_type> ( w * 64u + sax::countr_zero ( b ) );
+                if ( not m_entry_count[ page ] )
+                    decommit_page ( page );
+            }
+        }
+    }
+
+    void clear ( ) noexcept {
+        for ( size_type w = 0u; w < page_words; ++w ) {
+            for ( std::uint64_t b = m_page_bits[ w ]; b; b &= b - 1u )
+                decommit_page ( static_cast<size_type> ( w * 64u + sax::countr_zero ( b ) ) );
+        }
+        m_size = 0u;
+    }
+
+    // Iteration, over the present entries only, in index order.
+
+    struct entry {
+        size_type index;
+        reference value;
+    };
+    struct const_entry {
+        size_type index;
+        const_reference value;
+    };
+
+    template<bool Const>
+    struct iterator_impl {
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = std::conditional_t<Const, const_entry, entry>;
+        using difference_type   = std::ptrdiff_t;
+        using reference         = value_type;
+        using pointer           = void;
+
+        using array_pointer = std::conditional_t<Const, vm_sparse_array const *, vm_sparse_array *>;
+
+        iterator_impl ( ) noexcept = default;
+        iterator_impl ( array_pointer a_, size_type const i_ ) noexcept : m_array{ a_ }, m_index{ i_ } {}
+
+        [[nodiscard]] reference operator* ( ) const noexcept { return { m_index, *m_array->address ( m_index ) }; }
+
+        [[maybe_unused]] iterator_impl & operator++ ( ) noexcept {
+            m_index = m_array->next ( m_index + 1u );
+            return *this;
+        }
+        [[maybe_unused]] iterator_impl operator++ ( int ) noexcept {
+            iterator_impl tmp{ *this };
+            ++*this;
+            return tmp;
+        }
+
+        [[nodiscard]] bool operator== ( iterator_impl const & r_ ) const noexcept { return m_index == r_.m_index; }
+        [[nodiscard]] bool operator!= ( iterator_impl const & r_ ) const noexcept { return m_index != r_.m_index; }
+
+        private:
+        array_pointer m_array = nullptr;
+        size_type m_index     = Capacity;
+    };
+
+    using iterator       = iterator_impl<false>;
+    using const_iterator = iterator_impl<true>;
+
+    [[nodiscard]] const_iterator begin ( ) const noexcept { return { this, next ( 0u ) }; }
+    [[nodiscard]] const_iterator cbegin ( ) const noexcept { return begin ( ); }
+    [[nodiscard]] iterator begin ( ) noexcept { return { this, next ( 0u ) }; }
+
+    [[nodiscard]] const_iterator end ( ) const noexcept { return { this, Capacity }; }
+    [[nodiscard]] const_iterator cend ( ) const noexcept { return end ( ); }
+    [[nodiscard]] iterator end ( ) noexcept { return { this, Capacity }; }
+
+    // Calls f_ ( index, value ) for every entry present, in index order.
+    template<typename Function>
+    void for_each ( Function f_ ) {
+        for_each_page ( 0u, page_count, f_ );
+    }
+
+    // Calls f_ ( index, value ) for every entry present, the committed pages are divided over p_.threads
+    // threads, every page is visited by one thread.
+    template<typename Function>
+    void for_each ( simd::parallel_policy const & p_, Function f_ ) {
+        std::vector<size_type> pages;
+        pages.reserve ( m_committed_pages );
+        for ( size_type w = 0u; w < page_words; ++w ) {
+            for ( std::uint64_t b = m_page_bits[ w ]; b; b &= b - 1u )
+                pages.push_back ( static_cast<size_type> ( w * 64u + sax::countr_zero ( b ) ) );
+        }
+        std::size_t const threads =
+            std::max ( std::min<std::size_t> ( p_.threads ? p_.threads : std::thread::hardware_concurrency ( ), pages.size ( ) ),
+                       std::size_t{ 1u } );
+        std::size_t const slice = ( pages.size ( ) + threads - 1u ) / threads;
+        std::vector<std::thread> pool;
+        pool.reserve ( threads );
+        for ( std::size_t t = 0u; t < threads; ++t ) {
+            std::size_t const first = std::min ( t * slice, pages.size ( ) ), last = std::min ( first + slice, pages.size ( ) );
+            pool.emplace_back ( [ this, &pages, &f_, first, last ] {
+                for ( std::size_t i = first; i < last; ++i )
+                    visit_page ( pages[ i ], f_ );
+            } );
+        }
+        for ( std::thread & t : pool )
+            t.join ( );
+    }
+
+    private:
+    static constexpr std::size_t page_words  = ( page_count + 63u ) / 64u;    // Words in the page bitmap.
+    static constexpr std::size_t entry_words = ( page_capacity + 63u ) / 64u; // Words in the entry bitmap of a page.
+
+    // Releases the reservations made, also those of a partially constructed array.
+    void release ( ) noexcept {
+        for ( void * p : { static_cast<void *> ( m_data ), static_cast<void *> ( m_page_bits ),
+                           static_cast<void *> ( m_entry_count ), static_cast<void *> ( m_entry_bits ) } )
+            if ( HEDLEY_LIKELY ( p ) )
+                VirtualFree ( p, 0u, MEM_RELEASE );
+        m_data        = nullptr;
+        m_page_bits   = nullptr;
+        m_entry_count = nullptr;
+        m_entry_bits  = nullptr;
+    }
+
+    [[nodiscard]] static void * reserve_impl ( std::size_t const size_b_, DWORD const type_ ) {
+        void * p = VirtualAlloc ( nullptr, size_b_, type_, PAGE_READWRITE );
+        if ( HEDLEY_UNLIKELY ( not p ) )
+            throw std::bad_alloc ( );
+        return p;
+    }
+
+    // Commits the system pages spanning [ first_, first_ + size_b_ ), committing a committed page is a no-op.
+    static void commit_range ( void * first_, std::size_t const size_b_ ) {
+        if ( HEDLEY_UNLIKELY ( not VirtualAlloc ( first_, size_b_, MEM_COMMIT, PAGE_READWRITE ) ) )
+            throw std::bad_alloc ( );
+    }
+
+    [[nodiscard]] pointer address ( size_type const i_ ) const noexcept {
+        return reinterpret_cast<pointer> ( m_data + static_cast<std::size_t> ( i_ / page_capacity ) * page_size_b ) +
+               i_ % page_capacity;
+    }
+
+    [[nodiscard]] bool entry_bit ( size_type const page_, size_type const offset_ ) const noexcept {
+        return m_entry_bits[ page_ * entry_words + ( offset_ >> 6 ) ] >> ( offset_ & 63u ) & 1u;
+    }
+
+    void commit_page ( size_type const page_ ) {
+        commit_range ( m_data + static_cast<std::size_t> ( page_ ) * page_size_b, page_size_b );
+        // The metadata of the page, the system pages holding it stay committed once touched.
+        commit_range ( m_entry_count + page_, sizeof ( std::uint32_t ) );
+        commit_range ( m_entry_bits + page_ * entry_words, entry_words * sizeof ( std::uint64_t ) );
+        m_page_bits[ page_ >> 6 ] |= std::uint64_t{ 1u } << ( page_ & 63u );
+        ++m_committed_pages;
+    }
+
+    void decommit_page ( size_type const page_ ) noexcept {
+        VirtualFree ( m_data + static_cast<std::size_t> ( page_ ) * page_size_b, page_size_b, MEM_DECOMMIT );
+        std::fill_n ( m_entry_bits + page_ * entry_words, entry_words, std::uint64_t{ 0u } );
+        m_entry_count[ page_ ] = 0u;
+        m_page_bits[ page_ >> 6 ] &= ~( std::uint64_t{ 1u } << ( page_ & 63u ) );
+        --m_committed_pages;
+    }
+
+    [[nodiscard]] std::pair<pointer, bool> insert_impl ( size_type const i_ ) {
+        assert ( i_ < capacity ( ) );
+        size_type const page = i_ / page_capacity, offset = i_ % page_capacity;
+        if ( HEDLEY_UNLIKELY ( not page_committed ( page ) ) )
+            commit_page ( page );
+        std::uint64_t & w     = m_entry_bits[ page * entry_words + ( offset >> 6 ) ];
+        std::uint64_t const b = std::uint64_t{ 1u } << ( offset & 63u );
+        pointer const p       = address ( i_ );
+        if ( w & b )
+            return { p, false };
+        w |= b;
+        ++m_entry_count[ page ];
+        ++m_size;
+        return { new ( p ) value_type{ }, true };
+    }
+
+    // The first index >= i_ with an entry present, Capacity if none.
+    [[nodiscard]] size_type next ( size_type i_ ) const noexcept {
+        while ( i_ < Capacity ) {
+            size_type page = i_ / page_capacity;
+            if ( not page_committed ( page ) ) {
+                // Skip to the next committed page, a word of the page bitmap at a time.
+                std::size_t w      = page >> 6;
+                std::uint64_t bits = m_page_bits[ w ] & ( ~std::uint64_t{ 0u } << ( page & 63u ) );
+                while ( not bits and ++w < page_words )
+                    bits = m_page_bits[ w ];
+                if ( not bits )
+                    return Capacity;
+                page = static_cast<size_type> ( w * 64u + sax::countr_zero ( bits ) );
+                i_   = page * page_capacity;
+            }
+            size_type offset              = i_ % page_capacity;
+            std::uint64_t const * const e = m_entry_bits + page * entry_words;
+            for ( std::size_t w = offset >> 6; w < entry_words; ++w ) {
+                std::uint64_t const bits =
+                    e[ w ] & ( w == ( offset >> 6 ) ? ~std::uint64_t{ 0u } << ( offset & 63u ) : ~std::uint64_t{ 0u } );
+                if ( bits )
+                    return std::min ( static_cast<size_type> ( page * page_capacity + w * 64u + sax::countr_zero ( bits ) ),
+                                      Capacity );
+            }
+            i_ = ( page + 1u ) * page_capacity;
+        }
+        return Capacity;
+    }
+
+    template<typename Function>
+    void visit_page ( size_type const page_, Function & f_ ) {
+        std::uint64_t const * const e = m_entry_bits + page_ * entry_words;
+        pointer const d               = reinterpret_cast<pointer> ( m_data + static_cast<std::size_t> ( page_ ) * page_size_b );
+        for ( std::size_t w = 0u; w < entry_words; ++w ) {
+            for ( std::uint64_t b = e[ w ]; b; b &= b - 1u ) {
+                size_type const o = static_cast<size_type> ( w * 64u + sax::countr_zero ( b ) );
+                f_ ( static_cast<size_type> ( page_ * page_capacity + o ), d[ o ] );
+            }
+        }
+    }
+
+    template<typename Function>
+    void for_each_page ( size_type const first_, size_type const last_, Function & f_ ) {
+        for ( size_type p = first_; p < last_; ) {
+            std::uint64_t const bits = m_page_bits[ p >> 6 ] >> ( p & 63u );
+            if ( not bits ) {
+                p = ( ( p >> 6 ) + 1u ) << 6;
+                continue;
+            }
+            p += static_cast<size_type> ( sax::countr_zero ( bits ) );
+            if ( p < last_ )
+                visit_page ( p, f_ );
+            ++p;
+        }
+    }
+
+    char * m_data                 = nullptr;
+    std::uint64_t * m_page_bits   = nullptr;
+    std::uint32_t * m_entry_count = nullptr;
+    std::uint64_t * m_entry_bits  = nullptr;
+    size_type m_size = 0u, m_committed_pages = 0u;
+    bool m_decommit_empty;
+};
+
+} // namespace sax
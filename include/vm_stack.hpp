@@ -0,0 +1,161 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#ifndef NOMINMAX
+#    define NOMINMAX
+#endif
+
+#include <Memoryapi.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include <hedley.hpp>
+
+#include "winsys.hpp"
+
+namespace sax {
+
+// LIFO scratch allocator on a reserved range. Allocation bumps a pointer, committing 64KB pages on demand, a
+// marker records the current top and rolling back to it releases everything allocated since in O(1). After a
+// rollback, pages above the retained high-water mark are decommitted, so a spike does not stay pinned.
+
+template<typename SizeType, SizeType Capacity>
+struct vm_stack {
+
+    using size_type   = SizeType;
+    using marker_type = size_type; // Offset of the top from the base of the reservation.
+
+    vm_stack ( ) : vm_stack{ Capacity } {}
+
+    explicit vm_stack ( size_type const retained_b_ ) :
+        m_begin{ reinterpret_cast<char *> ( sax::win::virtual_alloc ( nullptr, capacity_b ( ), MEM_RESERVE, PAGE_READWRITE ) ) },
+        m_top{ 0u }, m_committed_b{ 0u }, m_retained_b{ round_up ( std::min ( retained_b_, capacity_b ( ) ) ) } {
+        if ( HEDLEY_UNLIKELY ( not m_begin ) )
+            throw std::bad_alloc ( );
+    }
+
+    vm_stack ( vm_stack const & )             = delete;
+    vm_stack & operator= ( vm_stack const & ) = delete;
+
+    ~vm_stack ( ) {
+        if ( HEDLEY_LIKELY ( m_begin ) ) {
+            sax::win::virtual_free ( m_begin, 0u, MEM_RELEASE );
+            m_begin = nullptr;
+            m_top = m_committed_b = 0u;
+        }
+    }
+
+    // Allocate.
+
+    // Returns uninitialized storage of size_b_ bytes, aligned to alignment_b_ (a power of 2, at most a page).
+    [[nodiscard]] void * allocate ( size_type const size_b_, size_type const alignment_b_ = alignof ( std::max_align_t ) ) {
+        assert ( alignment_b_ and not( alignment_b_ & ( alignment_b_ - 1u ) ) and alignment_b_ <= page_size_b );
+        size_type const first = ( m_top + alignment_b_ - 1u ) & ~( alignment_b_ - 1u );
+        if ( HEDLEY_UNLIKELY ( first > capacity_b ( ) or size_b_ > capacity_b ( ) - first ) )
+            throw std::bad_alloc ( );
+        size_type const last = first + size_b_;
+        if ( HEDLEY_UNLIKELY ( last > m_committed_b ) )
+            commit_impl ( last );
+        m_top = last;
+        return m_begin + first;
+    }
+
+    template<typename T>
+    [[nodiscard]] T * allocate_n ( size_type const n_ ) {
+        if ( HEDLEY_UNLIKELY ( n_ > std::numeric_limits<size_type>::max ( ) / sizeof ( T ) ) )
+            throw std::bad_alloc ( );
+        return reinterpret_cast<T *> ( allocate ( static_cast<size_type> ( n_ * sizeof ( T ) ), alignof ( T ) ) );
+    }
+
+    // Markers.
+
+    [[nodiscard]] marker_type marker ( ) const noexcept { return m_top; }
+
+    // Releases everything allocated after m_ was taken; objects living there are not destroyed.
+    void rollback ( marker_type const m_ ) noexcept {
+        assert ( m_ <= m_top );
+        m_top                = m_;
+        size_type const keep = std::max ( round_up ( m_top ), m_retained_b );
+        if ( HEDLEY_UNLIKELY ( m_committed_b > keep ) ) {
+            sax::win::virtual_alloc ( m_begin + keep, m_committed_b - keep, MEM_DECOMMIT, PAGE_NOACCESS );
+            m_committed_b = keep;
+        }
+    }
+
+    void clear ( ) noexcept { rollback ( 0u ); }
+
+    // Rolls back to the top at construction when going out of scope.
+    struct scope {
+        explicit scope ( vm_stack & s_ ) noexcept : m_stack{ s_ }, m_marker{ s_.marker ( ) } {}
+        scope ( scope const & )             = delete;
+        scope & operator= ( scope const & ) = delete;
+        ~scope ( ) noexcept { m_stack.rollback ( m_marker ); }
+
+        private:
+        vm_stack & m_stack;
+        marker_type m_marker;
+    };
+
+    // Size.
+
+    [[nodiscard]] static constexpr size_type capacity_b ( ) noexcept { return round_up ( Capacity ); }
+    [[nodiscard]] size_type size_b ( ) const noexcept { return m_top; }
+    [[nodiscard]] size_type committed_b ( ) const noexcept { return m_committed_b; }
+    [[nodiscard]] size_type retained_b ( ) const noexcept { return m_retained_b; }
+
+    // Takes effect at the next rollback.
+    void retain ( size_type const retained_b_ ) noexcept { m_retained_b = round_up ( std::min ( retained_b_, capacity_b ( ) ) ); }
+
+    private:
+    static constexpr size_type page_size_b = static_cast<size_type> ( 65'536 ); // 64KB
+
+    [[nodiscard]] static constexpr size_type round_up ( size_type const b_ ) noexcept {
+        return ( ( b_ + page_size_b - 1u ) / page_size_b ) * page_size_b;
+    }
+
+    void commit_impl ( size_type const required_b_ ) {
+        size_type const cib = round_up ( required_b_ );
+        if ( HEDLEY_UNLIKELY (
+                 not sax::win::virtual_alloc ( m_begin + m_committed_b, cib - m_committed_b, MEM_COMMIT, PAGE_READWRITE ) ) )
+            throw std::bad_alloc ( );
+        m_committed_b = cib;
+    }
+
+    char * m_begin;
+    size_type m_top, m_committed_b, m_retained_b;
+};
+
+} // namespace sax
@@ -0,0 +1,239 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <hedley.hpp>
+
+#include "bit_ops.hpp"
+#include "vm_backed.hpp"
+#include "vm_io.hpp"
+
+// An append-only store of strings (or blobs) in a vm_vector of bytes, the pages are committed as it grows and
+// it never moves, so the std::string_view's it hands out stay valid as long as the arena. A string is
+// identified by its offset, 32 bits up to a capacity of 4GB, and stored as its length (a LEB128 varint, 1
+// byte up to 127 bytes) followed by its bytes: a short string costs its length plus one byte, not a heap
+// allocation plus the 32 bytes of a std::string.
+//
+// With interning on, an open addressing hash index of the ids deduplicates on insert. The arena dumps to and
+// loads from a file in its own format (vm_io.hpp), the index is rebuilt on load.
+
+namespace sax {
+
+template<typename SizeType, SizeType Capacity>
+struct vm_string_arena {
+
+    using size_type = SizeType;
+    using id_type =
+        std::conditional_t<( Capacity <= SizeType{ std::numeric_limits<std::uint32_t>::max ( ) } ), std::uint32_t, std::uint64_t>;
+
+    using storage_type = vm_vector<char, size_type, Capacity>;
+
+    static constexpr id_type npos = std::numeric_limits<id_type>::max ( );
+
+    explicit vm_string_arena ( bool const intern_ = false ) : m_intern{ intern_ } {}
+
+    vm_string_arena ( vm_string_arena const & )             = delete;
+    vm_string_arena & operator= ( vm_string_arena const & ) = delete;
+
+    // Size.
+
+    [[nodiscard]] static constexpr size_type capacity_b ( ) noexcept { return Capacity; }
+    // The number of strings stored.
+    [[nodiscard]] std::size_t size ( ) const noexcept { return m_count; }
+    [[nodiscard]] bool empty ( ) const noexcept { return not m_count; }
+    [[nodiscard]] size_type size_b ( ) const noexcept { return m_bytes.size ( ); }
+    [[nodiscard]] bool interning ( ) const noexcept { return m_intern; }
+
+    // Access.
+
+    [[nodiscard]] std::string_view operator[] ( id_type const id_ ) const noexcept {
+        assert ( id_ < static_cast<id_type> ( size_b ( ) ) );
+        char const * p      = m_bytes.data ( ) + id_;
+        std::size_t const n = read_length ( p );
+        return { p, n };
+    }
+
+    // The id of s_, npos if it is not stored. Requires interning.
+    [[nodiscard]] id_type find ( std::string_view const s_ ) const noexcept {
+        assert ( m_intern );
+        if ( m_index.empty ( ) )
+            return npos;
+        for ( std::size_t i = hash ( s_ ) & mask ( );; i = ( i + 1u ) & mask ( ) ) {
+            id_type const id = m_index[ i ];
+            if ( id == npos or ( *this )[ id ] == s_ )
+                return id;
+        }
+    }
+
+    // Calls f_ ( id, view ) for every string, in the order of insertion.
+    template<typename Function>
+    void for_each ( Function && f_ ) const {
+        char const * const b = m_bytes.data ( );
+        for ( char const *p = b, *e = b + size_b ( ); p < e; ) {
+            id_type const id    = static_cast<id_type> ( p - b );
+            std::size_t const n = read_length ( p );
+            f_ ( id, std::string_view{ p, n } );
+            p += n;
+        }
+    }
+
+    // Modify.
+
+    // Stores s_ (or, interning, finds it), returns its id.
+    [[maybe_unused]] id_type insert ( std::string_view const s_ ) {
+        std::size_t slot = 0u;
+        if ( m_intern ) {
+            if ( HEDLEY_UNLIKELY ( ( m_count + 1u ) * 2u > m_index.size ( ) ) )
+                rehash ( std::max<std::size_t> ( m_index.size ( ) * 2u, 1'024u ) );
+            for ( slot = hash ( s_ ) & mask ( ); m_index[ slot ] != npos; slot = ( slot + 1u ) & mask ( ) )
+                if ( ( *this )[ m_index[ slot ] ] == s_ )
+                    return m_index[ slot ];
+        }
+        id_type const id = append ( s_ );
+        if ( m_intern )
+            m_index[ slot ] = id;
+        return id;
+    }
+    // Stores s_ (or, interning, finds it), returns a view of the stored string.
+    [[nodiscard]] std::string_view insert_view ( std::string_view const s_ ) { return ( *this )[ insert ( s_ ) ]; }
+
+    void clear ( ) {
+        m_bytes.clear ( ); // Keeps the pages, refilling them does not fault.
+        m_count = 0u;
+        std::fill ( m_index.begin ( ), m_index.end ( ), npos );
+    }
+
+    // Files.
+
+    // Writes the arena to the file at path_, replacing it.
+    void dump ( wchar_t const * const path_, io_options const & o_ = { } ) const { sax::dump ( m_bytes, path_, o_ ); }
+
+    // Appends the strings in the file at path_ (written by dump ( )), returns the number of strings read. The ids
+    // of the strings read are their ids in the file plus the size_b ( ) before the load. Interning, duplicates
+    // are loaded (and keep the id of the first one).
+    [[maybe_unused]] std::size_t load ( wchar_t const * const path_, io_options const & o_ = { } ) {
+        size_type const first = size_b ( );
+        sax::ingest ( m_bytes, path_, o_ );
+        std::size_t n        = 0u;
+        char const * const b = m_bytes.data ( );
+        char const * const e = b + size_b ( );
+        for ( char const * p = b + first; p < e; ++n ) {
+            std::size_t const l = read_length ( p, e );
+            if ( HEDLEY_UNLIKELY ( l > static_cast<std::size_t> ( e - p ) ) ) {
+                m_bytes.erase ( m_bytes.begin ( ) + first, m_bytes.end ( ) );
+                throw std::runtime_error ( "vm_string_arena: corrupt file" );
+            }
+            p += l;
+        }
+        m_count += n;
+        if ( m_intern )
+            rehash ( std::max<std::size_t> ( sax::bit_ceil ( m_count * 2u ), 1'024u ) );
+        return n;
+    }
+
+    private:
+    [[nodiscard]] std::size_t mask ( ) const noexcept { return m_index.size ( ) - 1u; }
+
+    // Decodes the length at p_ and advances p_ past it, returns the length or, if it overruns e_, the maximum.
+    [[nodiscard]] static std::size_t read_length ( char const *& p_, char const * const e_ = nullptr ) noexcept {
+        std::size_t n = 0u;
+        for ( int shift = 0;; shift += 7 ) {
+            if ( HEDLEY_UNLIKELY ( e_ and ( p_ == e_ or shift > 63 ) ) )
+                return std::numeric_limits<std::size_t>::max ( );
+            unsigned char const c = static_cast<unsigned char> ( *p_++ );
+            n |= static_cast<std::size_t> ( c & 0x7Fu ) << shift;
+            if ( not( c & 0x80u ) )
+                return n;
+        }
+    }
+
+    [[nodiscard]] id_type append ( std::string_view const s_ ) {
+        unsigned char length[ 10 ];
+        std::size_t l = 0u;
+        for ( std::size_t n = s_.size ( );; n >>= 7 ) {
+            length[ l++ ] = static_cast<unsigned char> ( ( n & 0x7Fu ) | ( n > 0x7Fu ? 0x80u : 0u ) );
+            if ( n <= 0x7Fu )
+                break;
+        }
+        if ( HEDLEY_UNLIKELY ( l + s_.size ( ) > static_cast<std::size_t> ( Capacity - size_b ( ) ) ) )
+            throw std::bad_alloc ( );
+        id_type const id = static_cast<id_type> ( size_b ( ) );
+        char * const p   = m_bytes.append_uninitialized ( static_cast<size_type> ( l + s_.size ( ) ) );
+        std::memcpy ( p, length, l );
+        std::memcpy ( p + l, s_.data ( ), s_.size ( ) );
+        ++m_count;
+        return id;
+    }
+
+    // Rebuilds the index with n_ (a power of 2) slots.
+    void rehash ( std::size_t const n_ ) {
+        m_index.assign ( n_, npos );
+        for_each ( [ this ] ( id_type const id_, std::string_view const s_ ) noexcept {
+            std::size_t i = hash ( s_ ) & mask ( );
+            for ( ; m_index[ i ] != npos; i = ( i + 1u ) & mask ( ) )
+                if ( ( *this )[ m_index[ i ] ] == s_ )
+                    return; // A duplicate (from a file).
+            m_index[ i ] = id_;
+        } );
+    }
+
+    [[nodiscard]] static std::size_t hash ( std::string_view const s_ ) noexcept {
+        char const * p  = s_.data ( );
+        std::size_t n   = s_.size ( );
+        std::uint64_t h = 0x9E37'79B9'7F4A'7C15ull ^ n;
+        for ( ; n >= 8u; p += 8, n -= 8u ) {
+            std::uint64_t w;
+            std::memcpy ( &w, p, 8u );
+            h = ( h ^ w ) * 0xFF51'AFD7'ED55'8CCDull;
+            h ^= h >> 32;
+        }
+        if ( n ) {
+            std::uint64_t w = 0u;
+            std::memcpy ( &w, p, n );
+            h = ( h ^ w ) * 0xC4CE'B9FE'1A85'EC53ull;
+        }
+        return static_cast<std::size_t> ( h ^ ( h >> 29 ) );
+    }
+
+    storage_type m_bytes;
+    std::vector<id_type> m_index; // Interning, npos is an empty slot.
+    std::size_t m_count = 0u;
+    bool m_intern;
+};
+
+} // namespace sax
@@ -24,21 +24,30 @@
 #pragma once
 
 #include <Memoryapi.h>
+#include <handleapi.h>
+#include <jobapi2.h>
 #include <processthreadsapi.h>
+#include <psapi.h>
+#include <sysinfoapi.h>
 
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 
+#include <algorithm>
 #include <charconv>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <utility>
 
 #include <hedley.hpp>
 
 #pragma comment( lib, "Advapi32.lib" )
+#pragma comment( lib, "onecore.lib" ) // VirtualAlloc2, MapViewOfFile3, UnmapViewOfFile2.
 
 namespace sax::win {
 
@@ -101,6 +110,35 @@ std::string last_error ( ) noexcept {
     set_privilege_impl ( get_token_handle ( ), privilege_name, enable_privilige );
 }
 
+// Owns a kernel object handle (file, event, file mapping), closes it on destruction.
+struct unique_handle {
+
+    unique_handle ( ) noexcept = default;
+    explicit unique_handle ( HANDLE h_ ) noexcept : m_handle{ h_ == INVALID_HANDLE_VALUE ? nullptr : h_ } {}
+    unique_handle ( unique_handle const & ) = delete;
+    unique_handle ( unique_handle && moving_ ) noexcept : m_handle{ std::exchange ( moving_.m_handle, nullptr ) } {}
+
+    ~unique_handle ( ) noexcept { reset ( ); }
+
+    unique_handle & operator= ( unique_handle const & ) = delete;
+    [[maybe_unused]] unique_handle & operator= ( unique_handle && moving_ ) noexcept {
+        reset ( std::exchange ( moving_.m_handle, nullptr ) );
+        return *this;
+    }
+
+    [[nodiscard]] HANDLE get ( ) const noexcept { return m_handle; }
+    [[nodiscard]] explicit operator bool ( ) const noexcept { return m_handle; }
+
+    void reset ( HANDLE h_ = nullptr ) noexcept {
+        if ( m_handle )
+            CloseHandle ( m_handle );
+        m_handle = h_;
+    }
+
+    private:
+    HANDLE m_handle = nullptr;
+};
+
 [[nodiscard]] inline size_t large_page_minimum ( ) noexcept { return GetLargePageMinimum ( ); }
 
 [[maybe_unused]] inline LPVOID virtual_alloc ( LPVOID lpAddress, SIZE_T dwSize, DWORD flAllocationType, DWORD flProtect ) noexcept {
@@ -110,4 +148,170 @@ std::string last_error ( ) noexcept {
     return VirtualFree ( lpAddress, dwSize, dwFreeType );
 }
 
+// Enables SeLockMemoryPrivilege (required for large pages) on the first call, returns whether the process holds
+// it. The outcome is cached, the privilege stays enabled for the lifetime of the process.
+[[nodiscard]] inline bool lock_memory_privilege ( ) noexcept {
+    static bool const held = [] ( ) noexcept {
+        try {
+            set_privilege ( SE_LOCK_MEMORY_NAME, true );
+            return true;
+        }
+        catch ( ... ) {
+            return false;
+        }
+    }( );
+    return held;
+}
+
+namespace detail {
+inline std::mutex working_set_mutex;
+} // namespace detail
+
+// Grows (or, with a negative delta_b_, shrinks) the minimum and maximum working set of the process. The minimum
+// working set is the RLIMIT_MEMLOCK of Windows, VirtualLock fails once the locked pages would exceed it.
+[[maybe_unused]] inline bool adjust_working_set ( std::ptrdiff_t const delta_b_ ) noexcept {
+    std::scoped_lock lock{ detail::working_set_mutex };
+    SIZE_T min_b, max_b;
+    if ( HEDLEY_UNLIKELY (
+             not GetProcessWorkingSetSize ( GetCurrentProcess ( ), std::addressof ( min_b ), std::addressof ( max_b ) ) ) )
+        return false;
+    if ( delta_b_ < 0 and static_cast<SIZE_T> ( -delta_b_ ) > min_b )
+        return false;
+    return SetProcessWorkingSetSize ( GetCurrentProcess ( ), min_b + delta_b_, max_b + delta_b_ );
+}
+
+// Locks [ p_, p_ + size_b_ ) into physical memory (faulting it in), growing the working set quota to make room.
+[[nodiscard]] inline bool lock_pages ( void * const p_, std::size_t const size_b_ ) noexcept {
+    if ( HEDLEY_UNLIKELY ( not adjust_working_set ( static_cast<std::ptrdiff_t> ( size_b_ ) ) ) )
+        return false;
+    if ( HEDLEY_UNLIKELY ( not VirtualLock ( p_, size_b_ ) ) ) {
+        DWORD const e = GetLastError ( );
+        adjust_working_set ( -static_cast<std::ptrdiff_t> ( size_b_ ) );
+        SetLastError ( e );
+        return false;
+    }
+    return true;
+}
+
+// Unlocks pages locked with lock_pages ( ) and hands the quota back, before they are decommitted or released.
+inline void unlock_pages ( void * const p_, std::size_t const size_b_ ) noexcept {
+    if ( VirtualUnlock ( p_, size_b_ ) )
+        adjust_working_set ( -static_cast<std::ptrdiff_t> ( size_b_ ) );
+}
+
+// The physical state of the (4KB) pages of a range, the mincore of Windows.
+struct residency {
+    std::size_t pages    = 0u;
+    std::size_t resident = 0u; // In the working set.
+    std::size_t locked   = 0u;
+    std::size_t large    = 0u; // Part of a large page.
+    std::size_t shared   = 0u;
+};
+
+[[nodiscard]] inline residency query_residency ( void const * const p_, std::size_t const size_b_ ) noexcept {
+    constexpr std::size_t page_b = 4'096u, batch = 512u;
+    residency r;
+    if ( HEDLEY_UNLIKELY ( not size_b_ ) )
+        return r;
+    char const * const b = reinterpret_cast<char const *> ( reinterpret_cast<std::uintptr_t> ( p_ ) & ~( page_b - 1u ) );
+    char const * const e = static_cast<char const *> ( p_ ) + size_b_;
+    PSAPI_WORKING_SET_EX_INFORMATION info[ batch ];
+    for ( char const * p = b; p < e; ) {
+        std::size_t n = 0u;
+        for ( ; n < batch and p < e; ++n, p += page_b )
+            info[ n ].VirtualAddress = const_cast<char *> ( p );
+        DWORD const size_b = static_cast<DWORD> ( n * sizeof ( info[ 0 ] ) );
+        if ( HEDLEY_UNLIKELY ( not QueryWorkingSetEx ( GetCurrentProcess ( ), info, size_b ) ) )
+            return r;
+        r.pages += n;
+        for ( std::size_t i = 0u; i < n; ++i ) {
+            PSAPI_WORKING_SET_EX_BLOCK const & a = info[ i ].VirtualAttributes;
+            if ( a.Valid ) {
+                ++r.resident;
+                r.locked += a.Locked;
+                r.large += a.LargePage;
+                r.shared += a.Shared;
+            }
+        }
+    }
+    return r;
+}
+
+// Brings [ p_, p_ + size_b_ ) into the working set ahead of its use, with large i/o's (MADV_WILLNEED), for
+// committed and for file backed (mapped) memory. Windows 8.
+[[maybe_unused]] inline bool prefetch_pages ( void * const p_, std::size_t const size_b_ ) noexcept {
+    WIN32_MEMORY_RANGE_ENTRY range{ p_, size_b_ };
+    return PrefetchVirtualMemory ( GetCurrentProcess ( ), 1u, std::addressof ( range ), 0u );
+}
+
+// Removes the (unlocked) pages of [ p_, p_ + size_b_ ) from the working set, to the standby (or modified) list:
+// the contents are kept, the pages are the first to be reused for another purpose (written to the page file if
+// modified) and a later access soft faults them back as long as they are not. That is MADV_COLD and, as far as
+// Windows goes, MADV_PAGEOUT. VirtualUnlock of pages that are not locked does just that (and fails with
+// ERROR_NOT_LOCKED), so locked pages must not be passed, they would be unlocked.
+inline void trim_pages ( void * const p_, std::size_t const size_b_ ) noexcept { VirtualUnlock ( p_, size_b_ ); }
+
+// Physical memory that can be handed out without paging (the MemAvailable of Windows).
+[[nodiscard]] inline std::size_t available_physical_memory ( ) noexcept {
+    MEMORYSTATUSEX ms;
+    ms.dwLength = sizeof ( MEMORYSTATUSEX );
+    if ( HEDLEY_UNLIKELY ( not GlobalMemoryStatusEx ( std::addressof ( ms ) ) ) )
+        return std::numeric_limits<std::size_t>::max ( );
+    return static_cast<std::size_t> ( ms.ullAvailPhys );
+}
+
+// Bytes the process can still commit before hitting the memory limit(s) of the job object it runs in (the
+// cgroup memory.max - memory.current of Windows containers), std::numeric_limits<std::size_t>::max ( ) if none.
+[[nodiscard]] inline std::size_t job_memory_headroom ( ) noexcept {
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION li;
+    if ( not QueryInformationJobObject ( nullptr, JobObjectExtendedLimitInformation, std::addressof ( li ),
+                                         sizeof ( JOBOBJECT_EXTENDED_LIMIT_INFORMATION ), nullptr ) )
+        return std::numeric_limits<std::size_t>::max ( ); // Not in a job.
+    std::size_t headroom = std::numeric_limits<std::size_t>::max ( );
+    if ( li.BasicLimitInformation.LimitFlags & JOB_OBJECT_LIMIT_JOB_MEMORY ) {
+        JOBOBJECT_MEMORY_USAGE_INFORMATION mu;
+        if ( QueryInformationJobObject ( nullptr, JobObjectMemoryUsageInformation, std::addressof ( mu ),
+                                         sizeof ( JOBOBJECT_MEMORY_USAGE_INFORMATION ), nullptr ) )
+            headroom = li.JobMemoryLimit > mu.JobMemory ? static_cast<std::size_t> ( li.JobMemoryLimit - mu.JobMemory ) : 0u;
+    }
+    if ( li.BasicLimitInformation.LimitFlags & JOB_OBJECT_LIMIT_PROCESS_MEMORY ) {
+        PROCESS_MEMORY_COUNTERS_EX pmc;
+        if ( GetProcessMemoryInfo ( GetCurrentProcess ( ), reinterpret_cast<PROCESS_MEMORY_COUNTERS *> ( std::addressof ( pmc ) ),
+                                    sizeof ( PROCESS_MEMORY_COUNTERS_EX ) ) )
+            headroom =
+                std::min ( headroom, li.ProcessMemoryLimit > pmc.PrivateUsage ? li.ProcessMemoryLimit - pmc.PrivateUsage : 0u );
+    }
+    return headroom;
+}
+
+// Placeholders (Windows 10, 1803), reserved address space into which a view of a section can be mapped in one
+// step: the view appears complete, there is no moment at which another thread can see part of it.
+
+[[nodiscard]] inline void * reserve_placeholder ( std::size_t const size_b_ ) noexcept {
+    return VirtualAlloc2 ( nullptr, nullptr, size_b_, MEM_RESERVE | MEM_RESERVE_PLACEHOLDER, PAGE_NOACCESS, nullptr, 0u );
+}
+
+// Splits [ p_, p_ + size_b_ ) off the placeholder containing it, fails if that is the whole placeholder.
+[[maybe_unused]] inline bool split_placeholder ( void * const p_, std::size_t const size_b_ ) noexcept {
+    return VirtualFree ( p_, size_b_, MEM_RELEASE | MEM_PRESERVE_PLACEHOLDER );
+}
+
+// Maps size_b_ bytes of section_ from offset_b_ into the placeholder at p_, which must be exactly that size.
+[[nodiscard]] inline void * map_placeholder ( HANDLE const section_, void * const p_, std::size_t const size_b_,
+                                              std::uint64_t const offset_b_ = 0u, ULONG const protect_ = PAGE_READWRITE ) noexcept {
+    HANDLE const process = GetCurrentProcess ( );
+    return MapViewOfFile3 ( section_, process, p_, offset_b_, size_b_, MEM_REPLACE_PLACEHOLDER, protect_, nullptr, 0u );
+}
+
+// Unmaps the view at p_, leaving a placeholder in its place.
+[[maybe_unused]] inline bool unmap_placeholder ( void * const p_ ) noexcept {
+    return UnmapViewOfFile2 ( GetCurrentProcess ( ), p_, MEM_PRESERVE_PLACEHOLDER );
+}
+
+// Releases the (unmapped) placeholders making up [ p_, p_ + size_b_ ).
+inline void release_placeholders ( void * const p_, std::size_t const size_b_ ) noexcept {
+    VirtualFree ( p_, size_b_, MEM_RELEASE | MEM_COALESCE_PLACEHOLDERS ); // Fails if it is a single one already.
+    VirtualFree ( p_, 0u, MEM_RELEASE );
+}
+
 } // namespace sax::win
@@ -48,7 +48,9 @@
 
 #include <hedley.hpp>
 
+#include "growth_policy.hpp"
 #include "vm_backed.hpp"
+#include "vm_bench.hpp"
 #include "winsys.hpp"
 
 // extern unsigned long __declspec( dllimport ) __stdcall GetProcessHeaps ( unsigned long NumberOfHeaps, void ** ProcessHeaps );
@@ -72,18 +74,31 @@ struct windows_system {
     // 209'715'200 = 200MB = 2 ^ 21
     //      65'536 =  64KB = 2 ^ 16
 
+    windows_system ( ) noexcept               = default;
+    windows_system ( windows_system const & ) = delete;
+    windows_system ( windows_system && moving_ ) noexcept :
+        m_reserved_pointer ( std::exchange ( moving_.m_reserved_pointer, nullptr ) ),
+        m_reserved_size_b ( std::exchange ( moving_.m_reserved_size_b, 0u ) ) {}
+
     ~windows_system ( ) noexcept ( false ) {
         if ( HEDLEY_LIKELY ( m_reserved_pointer ) ) {
             sax::win::virtual_free ( m_reserved_pointer, m_reserved_size_b, MEM_RELEASE );
             m_reserved_pointer = nullptr;
             m_reserved_size_b  = 0u;
         }
-        sax::win::set_privilege ( SE_LOCK_MEMORY_NAME, false );
+    }
+
+    windows_system & operator= ( windows_system const & ) = delete;
+
+    void swap ( windows_system & other_ ) noexcept {
+        std::swap ( m_reserved_pointer, other_.m_reserved_pointer );
+        std::swap ( m_reserved_size_b, other_.m_reserved_size_b );
     }
 
     [[nodiscard]] void_p reserve_and_commit_page ( size_t const capacity_b_ ) {
-        sax::win::set_privilege ( SE_LOCK_MEMORY_NAME, true );
         if constexpr ( HAVE_LARGE_PAGES ) {
+            if ( HEDLEY_UNLIKELY ( not sax::win::lock_memory_privilege ( ) ) )
+                throw std::runtime_error ( "the token does not have the specified privilege" );
             m_reserved_pointer =
                 sax::win::virtual_alloc ( nullptr, capacity_b_, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE );
         }
@@ -127,6 +142,15 @@ struct windows_system {
         sax::win::virtual_alloc ( ptr_, size_, MEM_RESET_UNDO, PAGE_READWRITE );
     }
 
+    [[nodiscard]] static sax::win::residency residency ( void_p ptr_, size_t size_ ) noexcept {
+        return sax::win::query_residency ( ptr_, size_ );
+    }
+    static void prefetch_page ( void_p ptr_, size_t size_ ) noexcept { sax::win::prefetch_pages ( ptr_, size_ ); }
+    template<bool HLP = HAVE_LARGE_PAGES, typename = std::enable_if_t<not HLP>>
+    static void page_out_page ( void_p ptr_, size_t size_ ) noexcept {
+        sax::win::trim_pages ( ptr_, size_ ); // Large pages are locked.
+    }
+
     template<typename T>
     constexpr size_t type_page_size ( size_t large_page_size_ = 0u ) noexcept {
         assert ( ( page_size_b / sizeof ( T ) ) * sizeof ( T ) == page_size_b );
@@ -145,15 +169,9 @@ size_t const windows_system<HAVE_LARGE_PAGES>::page_size_b = HAVE_LARGE_PAGES ?
 
 using sys = windows_system<false>;
 
-template<typename SizeType, typename = std::enable_if_t<std::is_unsigned<SizeType>::value>>
-struct growth_policy {
-    [[nodiscard]] static SizeType grow ( SizeType const & cap_b_ ) noexcept { return cap_b_ << 1; }
-    [[nodiscard]] static SizeType shrink ( SizeType const & cap_b_ ) noexcept { return cap_b_ >> 1; }
-};
-
 // Overload std::is_scalar for your type if it can be copied with std::memcpy.
 
-template<typename ValueType, typename SizeType, SizeType Capacity, typename growth_policy = growth_policy<SizeType>>
+template<typename ValueType, typename SizeType, SizeType Capacity, typename growth_policy = sax::growth_policy<SizeType>>
 struct virtual_vector {
 
     public:
@@ -196,13 +214,28 @@ struct virtual_vector {
         }
     }
 
-    virtual_vector ( virtual_vector && vv_ ) noexcept { std::swap ( std::move ( vv_ ), *this ); }
+    virtual_vector ( virtual_vector && vv_ ) noexcept :
+        m_sys{ std::move ( vv_.m_sys ) }, m_begin{ std::exchange ( vv_.m_begin, nullptr ) },
+        m_end{ std::exchange ( vv_.m_end, nullptr ) }, m_committed_b{ std::exchange ( vv_.m_committed_b, 0u ) } {}
 
     ~virtual_vector ( ) noexcept {
         clear_impl ( );
         m_sys.free_reserved_pages ( );
     }
 
+    [[maybe_unused]] virtual_vector & operator= ( virtual_vector && vv_ ) noexcept {
+        swap ( vv_ );
+        return *this;
+    }
+
+    void swap ( virtual_vector & other_ ) noexcept {
+        m_sys.swap ( other_.m_sys );
+        std::swap ( m_begin, other_.m_begin );
+        std::swap ( m_end, other_.m_end );
+        std::swap ( m_committed_b, other_.m_committed_b );
+    }
+    friend void swap ( virtual_vector & l_, virtual_vector & r_ ) noexcept { l_.swap ( r_ ); }
+
     private:
     void push_up_committed ( size_type const to_commit_size_b_ ) noexcept {
         size_type cib = m_committed_b;
@@ -260,12 +293,15 @@ struct virtual_vector {
 
     // Add.
 
+    // Throws sax::memory_pressure_error if the growth_policy refuses to grow (see sax::adaptive_growth_policy).
     template<typename... Args>
-    reference emplace_back ( Args &&... value_ ) noexcept {
+    reference emplace_back ( Args &&... value_ ) {
         if ( HEDLEY_LIKELY ( m_begin ) ) {
             if ( HEDLEY_UNLIKELY ( size_b ( ) == m_committed_b ) ) {
-                sys::commit_page ( m_end, m_committed_b );
-                m_committed_b = growth_policy::grow ( m_committed_b );
+                size_type const cib = growth_policy::grow ( m_committed_b );
+                if ( HEDLEY_UNLIKELY ( not sys::commit_page ( m_end, cib - m_committed_b ) ) )
+                    throw std::bad_alloc ( );
+                m_committed_b = cib;
             }
         }
         else {
@@ -274,11 +310,10 @@ struct virtual_vector {
         return *new ( m_end++ ) value_type{ std::forward<Args> ( value_ )... };
     }
     template<typename... Args>
-    reference push_back ( Args &&... value_ ) noexcept {
+    reference push_back ( Args &&... value_ ) {
         return emplace_back ( value_type{ std::forward<Args> ( value_ )... } );
     }
 
-    // TODO lowering growth factor when vector becomes really large as compared to free memory.
     // TODO virtual_queue
 
     // Data.
@@ -327,7 +362,7 @@ struct virtual_vector {
     sys m_sys;
     // Initialed with valid ptr to reserved memory and size = 0 (the number of committed pages).
     pointer m_begin = nullptr, m_end = nullptr;
-    size_type m_committed_b;
+    size_type m_committed_b = 0u;
 };
 
 void handleEptr ( std::exception_ptr eptr ) { // Passing by value is ok.
@@ -383,6 +418,24 @@ int main78909 ( ) {
     return EXIT_SUCCESS;
 }
 
+// Memory bus speed, CSV to std::cout (sax::bench::write_json for JSON).
+int main_bus_speed ( ) {
+
+    std::exception_ptr eptr;
+
+    try {
+        sax::bench::config c;
+        c.max_b = 4ull * 1'073'741'824ull; // 4GB.
+        sax::bench::write_csv ( std::cout, sax::bench::run ( c ) );
+    }
+    catch ( ... ) {
+        eptr = std::current_exception ( ); // Capture.
+    }
+    handleEptr ( eptr );
+
+    return EXIT_SUCCESS;
+}
+
 int main ( ) {
 
     std::exception_ptr eptr;